@@ -0,0 +1,162 @@
+/*
+ * arena.c -- Bump allocator for objects that die together.
+ *
+ * https://github.com/fontseca/lexemn
+ *
+ * Copyright (C) 2026 by Jeremy Fonseca <fontseca.dev@outlook.com>
+ *
+ * This file is part of Lexemn.
+ *
+ * Lexemn is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Lexemn is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Lexemn. If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+struct arena_block
+{
+    /* Block filled before this one.  */
+    struct arena_block *next;
+
+    /* Bytes in `data', and how many of them are handed out.  */
+    size_t size;
+    size_t used;
+
+    alignas(max_align_t) unsigned char data[];
+};
+
+void *
+arena_alloc(struct arena_t *const arena,
+                size_t const size,
+                size_t const align)
+{
+    struct arena_block *block = arena->head;
+
+    if (block)
+    {
+        uintptr_t const at  = (uintptr_t) (block->data + block->used);
+        size_t const    pad = (size_t) (-at & (align - 1));
+
+        if (pad + size <= block->size - block->used)
+        {
+            void *const mem = block->data + block->used + pad;
+            block->used += pad + size;
+            return mem;
+        }
+    }
+
+    /* The data of a new block is aligned to at least `max_align_t', which
+       leaves room for any padding a larger ALIGN needs.  */
+    size_t const need = size + (align > alignof(max_align_t) ? align : 0);
+    size_t const cap  = need > ARENA_BLOCK_SIZE ? need : ARENA_BLOCK_SIZE;
+
+    block = malloc(sizeof(struct arena_block) + cap);
+    if (!block)
+        return nullptr;
+
+    block->size = cap;
+    block->used = 0;
+
+    /* An oversized object gets a block of its own, which goes behind the
+       current one so that its free space is not wasted.  */
+    if (cap > ARENA_BLOCK_SIZE && arena->head)
+    {
+        block->next       = arena->head->next;
+        arena->head->next = block;
+    }
+    else
+    {
+        block->next = arena->head;
+        arena->head = block;
+    }
+
+    uintptr_t const at  = (uintptr_t) block->data;
+    size_t const    pad = (size_t) (-at & (align - 1));
+
+    block->used = pad + size;
+    return block->data + pad;
+}
+
+void *
+arena_resize(struct arena_t *const arena,
+                void *const ptr,
+                size_t const size,
+                size_t const new_size,
+                size_t const align)
+{
+    struct arena_block *const block = arena->head;
+
+    /* The last object of the current block can simply grow or shrink.  */
+    if (ptr && block
+        && (unsigned char *) ptr + size == block->data + block->used
+        && (new_size <= size || new_size - size <= block->size - block->used))
+    {
+        block->used = block->used - size + new_size;
+        return ptr;
+    }
+
+    void *const mem = arena_alloc(arena, new_size, align);
+
+    if (mem && ptr)
+        memcpy(mem, ptr, size < new_size ? size : new_size);
+
+    return mem;
+}
+
+static void *
+arena_allocator_resize(void *const ctx,
+                            void *const ptr,
+                            size_t const size,
+                            size_t const new_size)
+{
+    return arena_resize(ctx, ptr, size, new_size, alignof(max_align_t));
+}
+
+static void
+arena_allocator_release(void *const ctx,
+                            void *const ptr,
+                            size_t const size)
+{
+    (void) ctx;
+    (void) ptr;
+    (void) size;
+}
+
+struct allocator_t
+arena_allocator(struct arena_t *const arena)
+{
+    return (struct allocator_t) {
+        .resize  = arena_allocator_resize,
+        .release = arena_allocator_release,
+        .ctx     = arena,
+    };
+}
+
+void
+arena_free(struct arena_t *const arena)
+{
+    struct arena_block *block = arena->head;
+
+    while (block)
+    {
+        struct arena_block *const next = block->next;
+        free(block);
+        block = next;
+    }
+
+    arena->head = nullptr;
+}
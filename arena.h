@@ -0,0 +1,89 @@
+/*
+ * arena.h -- Bump allocator for objects that die together.
+ *
+ * https://github.com/fontseca/lexemn
+ *
+ * Copyright (C) 2026 by Jeremy Fonseca <fontseca.dev@outlook.com>
+ *
+ * This file is part of Lexemn.
+ *
+ * Lexemn is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Lexemn is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Lexemn. If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#ifndef TOK_ARENA_H
+#define TOK_ARENA_H
+
+#include <stddef.h>
+
+/* Memory is carved out of blocks at least this large.  */
+#define ARENA_BLOCK_SIZE  ( (size_t) 64 * 1024 )
+
+struct arena_block;
+
+/* Region of memory that hands out objects by bumping a pointer and releases
+   all of them at once.  A zero-initialized arena is empty and ready to use.  */
+struct arena_t
+{
+    /* Block that objects are currently carved out of, linked to the ones
+       filled before it.  */
+    struct arena_block *head;
+};
+
+/* Return SIZE bytes of memory from ARENA aligned to ALIGN, which must be a
+   power of two, or nullptr if no memory is left.  */
+[[nodiscard]]
+void *
+arena_alloc(struct arena_t *arena,
+                size_t size,
+                size_t align);
+
+/* Resize the SIZE bytes at PTR, which were the last ones handed out by
+   ARENA, to NEW_SIZE bytes in place if there is room left in their block.
+   Otherwise, or if PTR is some other object, copy them to NEW_SIZE bytes
+   from ARENA aligned to ALIGN.  PTR may be nullptr to get a new object.
+   Return nullptr if no memory is left.  */
+[[nodiscard]]
+void *
+arena_resize(struct arena_t *arena,
+                void *ptr,
+                size_t size,
+                size_t new_size,
+                size_t align);
+
+/* Release all the memory of ARENA at once, which is then empty again.  */
+void
+arena_free(struct arena_t *arena);
+
+/* Interface to a memory allocator, so that users of the lexer choose where
+   its memory comes from.  */
+struct allocator_t
+{
+    /* Return NEW_SIZE bytes holding the first SIZE bytes at PTR, which may
+       be nullptr for no bytes at all, or nullptr if no memory is left, in
+       which case PTR stays as it was.  */
+    void *(*resize)(void *ctx, void *ptr, size_t size, size_t new_size);
+
+    /* Give back the SIZE bytes at PTR.  */
+    void  (*release)(void *ctx, void *ptr, size_t size);
+
+    /* Passed to the functions above.  */
+    void  *ctx;
+};
+
+/* Return an allocator that carves memory out of ARENA.  Memory given back
+   to it is only reclaimed when ARENA is freed, which makes allocating as
+   cheap as bumping a pointer.  */
+struct allocator_t
+arena_allocator(struct arena_t *arena);
+
+#endif //TOK_ARENA_H
@@ -20,18 +20,36 @@
  * Lexemn. If not, see <https://www.gnu.org/licenses/>.
  **/
 
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
 #include <locale.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <readline/readline.h>
 #include <readline/history.h>
 
 #include "lexer.h"
+#include "lexer_cache.h"
+#include "lexer_trace.h"
 
 /* Forward declarations.  */
 static char *
 stripwhite(char *);
 
+static int
+lex_file(char const *);
+
+static void
+exec_cmd(struct tstream_t const *);
+
+static int
+lex_batch(void);
+
 /* When non-zero, this global means the user is done using this program.  */
 static int done;
 
@@ -41,8 +59,46 @@ main(int const argc,
 {
     char *line, *s;
 
+    /* Only needed by readline to display the user's input; the lexer
+       decodes UTF-8 on its own regardless of the locale.  */
     setlocale(LC_ALL, "");
 
+    /* Input that does not come from a terminal, or `--batch', is read in
+       large blocks and lexed as a whole rather than line by line.  */
+    bool batch = !isatty(STDIN_FILENO);
+    int  first = 1;
+
+    if (argc > 1 && 0 == strcmp(argv[1], "--batch"))
+    {
+        batch = true;
+        first = 2;
+    }
+
+    /* Source files given on the command line are lexed instead of starting
+       an interactive session.  */
+    if (argc > first)
+    {
+        int status = EXIT_SUCCESS;
+
+        for (int i = first; i < argc; ++i)
+        {
+            if (0 != lex_file(argv[i]))
+                status = EXIT_FAILURE;
+        }
+
+        return status;
+    }
+
+    if (batch)
+        return lex_batch();
+
+    /* Tokens of every line go to the same stream, whose memory comes from
+       an arena and is reused, so once the longest line has been seen no
+       further memory is allocated for them.  */
+    struct arena_t           arena  = { 0 };
+    struct allocator_t const alloc  = arena_allocator(&arena);
+    struct tstream_t         stream = { .alloc = &alloc };
+
     /* Loop reading and executing lines until the user quits.  */
     while (0 == done)
     {
@@ -56,24 +112,26 @@ main(int const argc,
            and execute it.  */
         s = stripwhite(line);
 
-        /* Make sure the string is null-terminated.  */
-        if (s[strlen(s) + 1] != '\0')
-            s[strlen(s) + 1] = '\0';
-
         if (*s)
         {
-            struct lexer_t   lexer;
-            struct tstream_t stream = { 0 };
+            struct lexer_t lexer;
 
+            tstream_reset(&stream);
             lex_setup(&lexer, (char unsigned const *)s);
-            lex_start(&lexer, &stream);
-            free(stream.tokens);
+
+            if (0 == lex_start(&lexer, &stream))
+                exec_cmd(&stream);
+            else
+                fprintf(stderr, "Out of memory\n");
+
             add_history(s);
         }
 
         free(line);
     }
 
+    tstream_free(&stream);
+    arena_free(&arena);
     return EXIT_SUCCESS;
 }
 
@@ -98,3 +156,545 @@ stripwhite(char *string)
 
     return s;
 }
+
+/* Return the path of the cache file of a source whose content hash is HASH,
+   which must be freed, or nullptr if sources are not cached.  Caching is
+   off unless LEXEMN_CACHE_DIR names a directory for the cache files, which
+   is created if need be.  */
+static char *
+cache_path(uint64_t const hash)
+{
+    char const *const dir = getenv("LEXEMN_CACHE_DIR");
+
+    if (!dir || !*dir)
+        return nullptr;
+
+    (void) mkdir(dir, 0700);
+
+    size_t const size = strlen(dir) + sizeof("/0123456789abcdef.lxc");
+    char *const  path = malloc(size);
+
+    if (path)
+        snprintf(path, size, "%s/%016" PRIx64 ".lxc", dir, hash);
+
+    return path;
+}
+
+/* Lex the source file at PATH.  The file is mapped read-only into memory and
+   scanned in place, so not a single byte of it is copied.  If caching is
+   on (see `cache_path'), tokens are kept in a cache file keyed by the
+   content of the source, so a source that was lexed before is not lexed
+   again; its tokens are mapped from that file instead.  Return zero on
+   success, or -1 if the file could not be read or lexed.  */
+static int
+lex_file(char const *const path)
+{
+    int const fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        perror(path);
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+
+    if (!S_ISREG(st.st_mode))
+    {
+        fprintf(stderr, "%s: Not a regular file\n", path);
+        close(fd);
+        return -1;
+    }
+
+    size_t const len = (size_t) st.st_size;
+    void *map = nullptr;
+
+    /* Mapping an empty file fails, but there is nothing to read anyway.  */
+    if (len > 0)
+    {
+        map = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (MAP_FAILED == map)
+        {
+            perror(path);
+            close(fd);
+            return -1;
+        }
+
+        /* The lexer reads the file front to back exactly once.  */
+        madvise(map, len, MADV_SEQUENTIAL);
+    }
+
+    close(fd);
+
+    char unsigned const *const source = map ? map : (void *) "";
+    uint64_t const             hash   = lex_cache_hash(source, len);
+    char *const                cached = cache_path(hash);
+    struct lex_cache_t         cache;
+
+    if (cached && 0 == lex_cache_load(cached, hash, len, &cache))
+    {
+        lex_cache_free(&cache);
+        free(cached);
+
+        if (map)
+            munmap(map, len);
+
+        return 0;
+    }
+
+    struct lexer_t     lexer;
+    struct ctstream_t  stream = { 0 };
+    struct lex_diags_t diags  = { 0 };
+
+    lex_setup_n(&lexer, source, len);
+    lexer.diags = &diags;
+
+    /* Checking the whole file up front spares checking each character as
+       it is scanned, unless some of it is not valid UTF-8; scanning finds
+       that out again anyway.  */
+    (void) lex_validate(&lexer);
+
+    int const ret = lex_start_compact(&lexer, &stream);
+
+    /* Every problem is reported, since scanning goes on past each.  */
+    for (size_t i = 0; i < diags.size; ++i)
+    {
+        struct position_t const where = lex_position(&lexer, diags.items[i].pos);
+
+        fprintf(stderr, "%s:%u:%u: %s\n", path, (unsigned) where.line,
+                (unsigned) where.column, lex_diag_message(diags.items[i].kind));
+    }
+
+    bool const failed = 0 != ret || diags.failed;
+    bool const clean  = 0 == diags.size && !failed;
+
+    /* Only well-formed sources are cached, so that a source that is not
+       keeps being reported.  A cache that cannot be written is no error.  */
+    if (cached && clean)
+        (void) lex_cache_store(cached, &stream, hash, len);
+
+    ctstream_free(&stream);
+    lex_diags_free(&diags);
+    lex_free(&lexer);
+    free(cached);
+
+    if (map)
+        munmap(map, len);
+
+    if (failed)
+    {
+        fprintf(stderr, "%s: Out of memory\n", path);
+        return -1;
+    }
+
+    return clean ? 0 : -1;
+}
+
+/* Standard input is read in blocks of at least this many bytes in batch
+   mode.  */
+#define BATCH_BLOCK_SIZE  ( (size_t) 64 * 1024 )
+
+/* Running count of the statements of a source lexed in pieces.  A statement
+   ends at a `;' outside of braces, or at the brace that closes the body of
+   a function.  */
+struct tally_t
+{
+    size_t statements;
+    size_t commands;
+    size_t tokens;
+
+    /* Braces open in the current statement.  */
+    size_t depth;
+
+    /* Set inside a statement, and inside one that defines a function.  */
+    bool open;
+    bool func;
+};
+
+/* Count the statements and tokens in STREAM towards TALLY.  */
+static void
+tally_stream(struct tally_t *const tally,
+                struct tstream_t const *const stream)
+{
+    for (size_t i = 0; i < stream->size; ++i)
+    {
+        enum token_type const type = stream->tokens[i].type;
+
+        if (TOK_END == type)
+            continue;
+
+        ++tally->tokens;
+
+        /* A `;' right after a function body ends nothing.  */
+        if (!tally->open && TOK_SEMICOLON != type)
+        {
+            tally->open = true;
+            tally->func = false;
+            ++tally->statements;
+        }
+
+        if (TOK_FUNC == type)
+            tally->func = true;
+        else if (TOK_LBRACE == type)
+            ++tally->depth;
+        else if (TOK_RBRACE == type && tally->depth > 0)
+            tally->open = 0 != --tally->depth || !tally->func;
+        else if (TOK_SEMICOLON == type && 0 == tally->depth)
+            tally->open = false;
+    }
+}
+
+/* Return the offset of the first line at or past FROM in the LEN bytes of
+   BUF that starts with a meta-command, blanks aside, or LEN if none does.
+   BOL tells whether BUF itself starts a line.  */
+static size_t
+find_cmd_line(char unsigned const *const buf,
+                size_t const from,
+                size_t const len,
+                bool const bol)
+{
+    char unsigned const *p = buf + from;
+    char unsigned const *q;
+
+    while ((q = memchr(p, '\\', (size_t) (buf + len - p))))
+    {
+        char unsigned const *s = q;
+
+        while (s > buf && whitespace(s[-1]))
+            --s;
+
+        if (s > buf ? '\n' == s[-1] : bol)
+            return (size_t) (s - buf);
+
+        p = q + 1;
+    }
+
+    return len;
+}
+
+/* Return true if LEXER, fed up to the start of a line, is not inside a
+   comment or a string, which are the only tokens that go on past a line
+   feed.  The bytes it holds back hold no more than the tokens next to the
+   end of the last chunk, so the string, if any, is among them.  */
+static bool
+between_tokens(struct lexer_t const *const lexer)
+{
+    if (LEX_STATE_COMMENT == lexer->state)
+        return false;
+
+    /* The rest of a meta-command scanned in the middle of a line is its
+       arguments, even if quoted.  */
+    if (LEX_STATE_COMMAND == lexer->state)
+        return true;
+
+    char unsigned const *p   = lexer->carry + lexer->carry_off;
+    char unsigned const *end = p + lexer->carry_len;
+
+    while (p < end)
+    {
+        /* Likewise for one whose name is held back.  */
+        if ('\\' == *p)
+            return true;
+
+        if ('"' == *p)
+        {
+            /* Skip the text, where a `\' escapes the next byte.  */
+            for (++p; p < end && '"' != *p; ++p)
+            {
+                if ('\\' == *p)
+                    ++p;
+            }
+
+            if (p >= end)
+                return false;
+        }
+        else if ('{' == *p && end - p >= 3 && 0 == memcmp(p, "{{*", 3))
+        {
+            char unsigned const *star = p + 2;
+
+            do
+                star = memchr(star + 1, '*', (size_t) (end - star - 1));
+            while (star && (end - star < 3 || '}' != star[1] || '}' != star[2]));
+
+            if (!star)
+                return false;
+
+            p = star + 2;
+        }
+
+        ++p;
+    }
+
+    return true;
+}
+
+/* Report the problems in DIAGS from the FROM-th on, which were found in
+   standard input SKIPPED bytes before the offset the lexer gives them, as
+   the meta-command lines are not fed to it.  Return the number of problems
+   in DIAGS.  */
+static size_t
+report_diags(struct lex_diags_t const *const diags,
+                size_t const from,
+                size_t const skipped)
+{
+    for (size_t i = from; i < diags->size; ++i)
+        fprintf(stderr, "stdin: offset %zu: %s\n", skipped + diags->items[i].pos,
+                lex_diag_message(diags->items[i].kind));
+
+    return diags->size;
+}
+
+/* Lex standard input as a whole and report how many statements it holds.
+   Unlike the interactive session, which lexes each line on its own, the
+   input is read in large blocks and fed to a single lexer, so a statement
+   may span lines, e.g., the body of a function.  Lines that start with a
+   meta-command are still lexed and executed one at a time, as they would
+   be if typed in.  Return the exit status of the program.  */
+static int
+lex_batch(void)
+{
+    struct lexer_t     lexer;
+    struct tstream_t   stream = { 0 };
+    struct tstream_t   line   = { 0 };
+    struct tally_t     tally  = { 0 };
+    struct lex_diags_t diags  = { 0 };
+    int                status = EXIT_SUCCESS;
+
+    /* Bytes of BUF not lexed yet, the start of a meta-command line that
+       goes on in the next block, say.  */
+    size_t         cap = BATCH_BLOCK_SIZE;
+    size_t         len = 0;
+    char unsigned *buf = malloc(cap);
+
+    if (!buf)
+    {
+        perror("stdin");
+        return EXIT_FAILURE;
+    }
+
+    /* Problems reported so far, and bytes of meta-command lines.  */
+    size_t reported = 0;
+    size_t skipped  = 0;
+
+    /* Set when BUF starts a line.  */
+    bool bol = true;
+    bool eof = false;
+
+    lex_setup_stream(&lexer);
+    lexer.diags = &diags;
+
+    while (!eof && EXIT_SUCCESS == status)
+    {
+        /* A line does not fit; make room for the rest of it.  */
+        if (len == cap)
+        {
+            char unsigned *const more = realloc(buf, 2 * cap);
+            if (!more)
+            {
+                perror("stdin");
+                status = EXIT_FAILURE;
+                break;
+            }
+
+            buf  = more;
+            cap *= 2;
+        }
+
+        ssize_t const got = read(STDIN_FILENO, buf + len, cap - len);
+        if (got < 0)
+        {
+            if (EINTR == errno)
+                continue;
+
+            perror("stdin");
+            status = EXIT_FAILURE;
+            break;
+        }
+
+        eof  = 0 == got;
+        len += (size_t) got;
+
+        size_t used = 0;
+        size_t from = 0;
+
+        while (used < len)
+        {
+            size_t const at = find_cmd_line(buf, from, len, bol);
+
+            if (0 != lex_feed(&lexer, buf + used, at - used, &stream))
+            {
+                fprintf(stderr, "Out of memory\n");
+                status = EXIT_FAILURE;
+                break;
+            }
+
+            reported = report_diags(&diags, reported, skipped);
+
+            used = at;
+            if (at == len)
+                break;
+
+            /* A backslash inside a comment or a string is lexed along with
+               it.  */
+            if (!between_tokens(&lexer))
+            {
+                from = (size_t) ((char unsigned const *) memchr(buf + at, '\\', len - at) - buf) + 1;
+                continue;
+            }
+
+            char unsigned const *const nl = memchr(buf + at, '\n', len - at);
+            if (!nl && !eof)
+                break;
+
+            size_t const stop = nl ? (size_t) (nl - buf) : len;
+
+            /* Whatever came before the meta-command is done with.  */
+            if (0 != lex_finish(&lexer, &stream))
+            {
+                fprintf(stderr, "Out of memory\n");
+                status = EXIT_FAILURE;
+                break;
+            }
+
+            reported = report_diags(&diags, reported, skipped);
+
+            struct lexer_t cmd;
+
+            tstream_reset(&line);
+            lex_setup_n(&cmd, buf + at, stop - at);
+
+            if (0 == lex_start(&cmd, &line))
+                exec_cmd(&line);
+            else
+                fprintf(stderr, "Out of memory\n");
+
+            ++tally.commands;
+            used     = from = nl ? stop + 1 : len;
+            skipped += used - at;
+        }
+
+        tally_stream(&tally, &stream);
+        tstream_reset(&stream);
+
+        /* Keep the line that goes on in the next block.  */
+        if (used > 0)
+        {
+            bol = '\n' == buf[used - 1];
+            memmove(buf, buf + used, len - used);
+            len -= used;
+        }
+    }
+
+    if (EXIT_SUCCESS == status && 0 != lex_finish(&lexer, &stream))
+    {
+        fprintf(stderr, "Out of memory\n");
+        status = EXIT_FAILURE;
+    }
+
+    (void) report_diags(&diags, reported, skipped);
+    tally_stream(&tally, &stream);
+
+    if (EXIT_SUCCESS == status)
+        printf("%zu statements, %zu meta-commands, %zu tokens\n",
+               tally.statements, tally.commands, tally.tokens);
+
+    if (diags.failed)
+        fprintf(stderr, "stdin: Out of memory\n");
+
+    if (diags.size > 0 || diags.failed)
+        status = EXIT_FAILURE;
+
+    lex_diags_free(&diags);
+    tstream_free(&line);
+    tstream_free(&stream);
+    lex_free(&lexer);
+    free(buf);
+    return status;
+}
+
+/* Return non-zero value if the text of TOKEN is exactly STR.  */
+static bool
+tok_is(struct token_t const *const token, char const *const str)
+{
+    size_t const len = strlen(str);
+
+    return token->val.text.len == len
+                && 0 == memcmp(token->val.text.str, str, len);
+}
+
+/* Execute the meta-command scanned into STREAM, if any.  Supported
+   meta-commands are:
+
+       \exec -f <file> [-f <file> ...]    Lex source files.
+       \stats [reset]                     Print, or zero, the trace of the
+                                          lexer (see lexer_trace.h).  */
+static void
+exec_cmd(struct tstream_t const *const stream)
+{
+    struct token_t const *const tokens = stream->tokens;
+
+    if (TOK_CMD != tokens[0].type)
+        return;
+
+    if (tok_is(&tokens[0], "\\stats"))
+    {
+        if (TOK_CMD_ARG != tokens[1].type)
+            lex_trace_dump(stdout);
+        else if (tok_is(&tokens[1], "reset") && TOK_CMD_ARG != tokens[2].type)
+            lex_trace_reset();
+        else
+            fprintf(stderr, "Usage: \\stats [reset]\n");
+
+        return;
+    }
+
+    if (!tok_is(&tokens[0], "\\exec"))
+    {
+        fprintf(stderr, "Unknown meta-command `%.*s'\n",
+                (int) tokens[0].val.text.len, (char const *) tokens[0].val.text.str);
+        return;
+    }
+
+    if (TOK_CMD_ARG != tokens[1].type)
+    {
+        fprintf(stderr, "Usage: \\exec -f <file> [-f <file> ...]\n");
+        return;
+    }
+
+    for (size_t i = 1; TOK_CMD_ARG == tokens[i].type; i += 2)
+    {
+        if (!tok_is(&tokens[i], "-f") || TOK_CMD_ARG != tokens[i + 1].type)
+        {
+            fprintf(stderr, "Usage: \\exec -f <file> [-f <file> ...]\n");
+            return;
+        }
+
+        /* Drop the quotes around the file name, if any.  */
+        char const *name = (char const *) tokens[i + 1].val.text.str;
+        size_t      len  = tokens[i + 1].val.text.len;
+
+        if (len > 0 && ('"' == name[0] || '\'' == name[0]))
+        {
+            ++name;
+            --len;
+
+            if (len > 0 && name[len - 1] == name[-1])
+                --len;
+        }
+
+        char *const path = strndup(name, len);
+        if (!path)
+        {
+            perror("\\exec");
+            return;
+        }
+
+        (void) lex_file(path);
+        free(path);
+    }
+}
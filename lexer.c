@@ -20,19 +20,31 @@
  * Lexemn. If not, see <https://www.gnu.org/licenses/>.
  **/
 
-#include <ctype.h>
+#include <math.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdckdint.h>
 #include <stdlib.h>
-#include <uchar.h>
 #include <stdio.h>
+#include <string.h>
+#include <threads.h>
 
 #include "lexer.h"
+#include "lexer_float.h"
+#include "lexer_simd.h"
+#include "lexer_trace.h"
+#include "utf8.h"
+#include "ucn_table.h"
+#include "keyword_table.h"
+#include "const_table.h"
+#include "op_table.h"
+#include "scan_table.h"
 
 /* Reflect how the token's text is managed in memory.  */
 enum spell_type : short unsigned
 {
     SPELL_OPERATOR,
+    SPELL_KEYWORD,
     SPELL_IDENT,
     SPELL_LITERAL,
     SPELL_NONE
@@ -46,12 +58,13 @@ struct token_spelling
 
 /* Array indexed by 'lex_token_type_t' providing descriptive names and literal
    spellings for debugging and diagnostic emission.  */
-[[maybe_unused]]
 static struct token_spelling const token_spellings[MAX_TOKENS] = {
 #define OP( name, raw ) { SPELL_OPERATOR, (char unsigned const *) raw },
+#define KW( name, raw ) { SPELL_KEYWORD, (char unsigned const *) raw },
 #define TOK( name, raw ) { SPELL_ ## raw, (char unsigned const *) #name },
     TOK_TYPES_TABLE
 #undef TOK
+#undef KW
 #undef OP
 };
 
@@ -65,109 +78,99 @@ static struct token_spelling const token_spellings[MAX_TOKENS] = {
         ? token_spellings[(token.type)].name \
             : "" )
 
+/* Return non-zero value if tokens of type TYPE carry text, unlike operators
+   and keywords, whose spelling is fixed by the type, TOK_UNK and TOK_END.  */
+#define TOK_HAS_TEXT( type ) \
+    ( SPELL_OPERATOR != token_spellings[( type )].category \
+      && SPELL_KEYWORD != token_spellings[( type )].category \
+      && TOK_UNK != ( type ) && TOK_END != ( type ) )
+
+/* Return non-zero value if tokens of type TYPE keep a value in the `lens'
+   of a compact stream: the length of their text, or the kind of problem
+   of a TOK_UNK.  */
+#define CT_HAS_LEN( type ) \
+    ( TOK_HAS_TEXT( type ) || TOK_UNK == ( type ) )
+
 /* Return non-zero value if C is a non-printable character.  */
 #define IS_WHITESPACE( c ) \
     ( ( c ) == ' '  || ( c ) == '\t' || \
       ( c ) == '\n' || ( c ) == '\r' || \
       ( c ) == '\v' || ( c ) == '\f' )
 
-/* Return non-zero if the numerical value of the character C is falls within
-   the specified closed range [LOWER, UPPER].  */
-#define IS_BETWEEN( c, lower, upper ) \
-    ( ( c ) >= ( lower ) && ( c ) <= ( upper ) )
-
-/* Return non-zero value if the wide character C typed as char32_t is valid
-   as part of an identifier.  In addition to the standard ASCII characters
-   normally used (`_', `a-z', `A-Z'), this macro accepts Universal Character
-   Names (UCNs) allowed in the C programming language per ISO/IEC 9899:201x
-   Annex D: Universal character names for identifiers.  */
-#define IS_IDENTIFIER( c )                      \
-       (00 /* Standard ASCII characters.  */    \
-        || ( c ) == '_'                         \
-        || IS_BETWEEN(( c ), 'A', 'Z')          \
-        || IS_BETWEEN(( c ), 'a', 'z')          \
-        ||                                      \
-        00 /* Latin-1 supplement (part 1).  */  \
-        || IS_BETWEEN(( c ), 0x00B2, 0x00B5)    \
-        || IS_BETWEEN(( c ), 0x00B7, 0x00BA)    \
-        || IS_BETWEEN(( c ), 0x00BC, 0x00BE)    \
-        || IS_BETWEEN(( c ), 0x00C0, 0x00D6)    \
-        ||                                      \
-        00 /* Latin-1 supplement (part 2).  */  \
-        || IS_BETWEEN(( c ), 0x00D8, 0x00F6)    \
-        || IS_BETWEEN(( c ), 0x00F8, 0x00FF)    \
-        ||                                      \
-        00 /* Extended Latin, Greek, Cyrillic,  \
-        00  Hebrew, Arabic, etc.  */            \
-        || IS_BETWEEN(( c ), 0x0100, 0x167F)    \
-        || IS_BETWEEN(( c ), 0x1681, 0x180D)    \
-        || IS_BETWEEN(( c ), 0x180F, 0x1FFF)    \
-        ||                                      \
-        00 /* Formatting, directional controls, \
-        00  & combining marks.  */              \
-        || IS_BETWEEN(( c ), 0x200B, 0x200D)    \
-        || IS_BETWEEN(( c ), 0x202A, 0x202E)    \
-        || IS_BETWEEN(( c ), 0x203F, 0x2040)    \
-        || IS_BETWEEN(( c ), 0x2060, 0x206F)    \
-        ||                                      \
-        00 /* Technical symbols, number forms,  \
-        00  enclosed alphanumerics.  */         \
-        || IS_BETWEEN(( c ), 0x2070, 0x218F)    \
-        || IS_BETWEEN(( c ), 0x2460, 0x24FF)    \
-        || IS_BETWEEN(( c ), 0x2776, 0x2793)    \
-        || IS_BETWEEN(( c ), 0x2C00, 0x2DFF)    \
-        || IS_BETWEEN(( c ), 0x2E80, 0x2FFF)    \
-        ||                                      \
-        00 /* CJK symbols & punctuation.  */    \
-        || IS_BETWEEN(( c ), 0x3004, 0x3007)    \
-        || IS_BETWEEN(( c ), 0x3021, 0x302F)    \
-        || IS_BETWEEN(( c ), 0x3031, 0x303F)    \
-        ||                                      \
-        00 /* Unified East Asian scripts        \
-        00  (primary CJK block).  */            \
-        || IS_BETWEEN(( c ), 0x3040, 0xD7FF)    \
-        ||                                      \
-        00 /* CJK Compatibility ideographs &    \
-        00  Arabic presentation forms.  */      \
-        || IS_BETWEEN(( c ), 0xF900, 0xFD3D)    \
-        || IS_BETWEEN(( c ), 0xFD40, 0xFDCF)    \
-        || IS_BETWEEN(( c ), 0xFDF0, 0xFE44)    \
-        || IS_BETWEEN(( c ), 0xFE47, 0xFFFD)    \
-        ||                                      \
-        00 /* Supplementary  ideographic planes \
-        00  (plane 1 - plane 14).  Contains     \
-        00  supplementary multilingual (SMP),   \
-        00  supplementary ideographic (SIP),    \
-        00  and tertiary ideographic (TIP)      \
-        00  planes. */                          \
-        || IS_BETWEEN(( c ), 0x10000, 0x1FFFD)  \
-        || IS_BETWEEN(( c ), 0x20000, 0x2FFFD)  \
-        || IS_BETWEEN(( c ), 0x30000, 0x3FFFD)  \
-        || IS_BETWEEN(( c ), 0x40000, 0x4FFFD)  \
-        || IS_BETWEEN(( c ), 0x50000, 0x5FFFD)  \
-        || IS_BETWEEN(( c ), 0x60000, 0x6FFFD)  \
-        || IS_BETWEEN(( c ), 0x70000, 0x7FFFD)  \
-        || IS_BETWEEN(( c ), 0x80000, 0x8FFFD)  \
-        || IS_BETWEEN(( c ), 0x90000, 0x9FFFD)  \
-        || IS_BETWEEN(( c ), 0xA0000, 0xAFFFD)  \
-        || IS_BETWEEN(( c ), 0xB0000, 0xBFFFD)  \
-        || IS_BETWEEN(( c ), 0xC0000, 0xCFFFD)  \
-        || IS_BETWEEN(( c ), 0xD0000, 0xDFFFD)  \
-        || IS_BETWEEN(( c ), 0xE0000, 0xEFFFD))
+/* Return non-zero value if the byte C is an ASCII decimal digit.  Unlike
+   `isdigit', this does not depend on the process locale.  */
+#define IS_DIGIT( c ) \
+    ( (unsigned) ( c ) - '0' < 10u )
+
+/* Return the class bits (see ucn.def) of the code point C.  The classes
+   live in a two-stage table generated at build time by lexer_gen.c, so
+   any character is classified with two memory loads.  */
+#define UCN_CLASS( c ) \
+    ( ucn_pages[ucn_index[( c ) >> UCN_PAGE_BITS]] \
+               [( c ) & ( ( 1u << UCN_PAGE_BITS ) - 1 )] )
+
+/* Return non-zero value if the wide character C typed as char32_t may
+   start an identifier.  */
+#define IS_IDENTIFIER( c ) \
+    ( UCN_CLASS(c) & UCN_IDENT )
+
+/* Return non-zero value if the wide character C typed as char32_t may
+   continue an identifier, i.e., it is also allowed to be a digit.  */
+#define IS_IDENTIFIER_REST( c ) \
+    ( UCN_CLASS(c) & ( UCN_IDENT | UCN_DIGIT ) )
+
+/* Return non-zero value if the byte C is one of [0-9a-zA-Z_].  */
+#define IS_WORD( c ) \
+    ( ( c ) < 0x80 && IS_IDENTIFIER_REST(c) )
 
 void
 lex_setup(struct lexer_t *const lexer,
                 char unsigned const *const whence)
 {
-    lexer->buf = (char unsigned const *)whence;
-    lexer->cur = (char unsigned const *)whence;
+    lex_setup_n(lexer, whence, strlen((char const *) whence));
+}
+
+/* Point LEXER at the LEN bytes at BUF without touching any other state.  */
+static void
+lex_setup_range(struct lexer_t *const lexer,
+                    char unsigned const *const buf,
+                    size_t const len)
+{
+    lexer->buf = buf;
+    lexer->cur = buf;
+    lexer->end = buf + len;
+}
+
+void
+lex_setup_stream(struct lexer_t *const lexer)
+{
+    *lexer = (struct lexer_t) { .state = LEX_STATE_CODE, .final = true };
+}
+
+void
+lex_setup_n(struct lexer_t *const lexer,
+                char unsigned const *const buf,
+                size_t const len)
+{
+    lex_setup_stream(lexer);
+    lex_setup_range(lexer, buf, len);
 }
 
-/* Return non-zero value if LEXER has reached the end of the input source.  */
+/* Return non-zero value if LEXER has reached the end of the input source.
+   The source is bounded by a pointer, so unlike testing for a terminating
+   NUL this does not even touch memory.  */
 static bool
 eof(struct lexer_t const *const lexer)
 {
-    return '\0' == *lexer->cur;
+    return lexer->cur >= lexer->end;
+}
+
+/* Return the offset in the whole input source of the byte at P in LEXER.  */
+static uint32_t
+offset_of(struct lexer_t const *const lexer,
+                char unsigned const *const p)
+{
+    return (uint32_t) (lexer->base + (size_t) (p - lexer->buf));
 }
 
 /* Return non-zero value if the character I bytes ahead of the current position
@@ -175,7 +178,7 @@ eof(struct lexer_t const *const lexer)
 static bool
 eof_at(struct lexer_t const *const lexer, uint32_t const i)
 {
-    return '\0' == lexer->cur[i];
+    return (size_t) (lexer->end - lexer->cur) <= i;
 }
 
 /* Return a pointer to the current read position in the input source of LEXER.  */
@@ -186,19 +189,21 @@ current(struct lexer_t const *lexer)
 }
 
 /* Return the character at the current read position in the input source
-   of LEXER without advancing the pointer.  */
+   of LEXER without advancing the pointer, or NUL at the end of the input
+   source.  */
 static char unsigned
 peek(struct lexer_t const *const lexer)
 {
-    return *lexer->cur;
+    return eof(lexer) ? '\0' : *lexer->cur;
 }
 
 /* Return the character N bytes ahead of the current position in LEXER
-   without advancing in the input source.  */
+   without advancing in the input source, or NUL past the end of the input
+   source.  */
 static char unsigned
 peek_at(struct lexer_t const *const lexer, uint32_t const n)
 {
-    return *(n + lexer->cur);
+    return eof_at(lexer, n) ? '\0' : lexer->cur[n];
 }
 
 /* Advance the current read position in LEXER by one byte.  */
@@ -215,22 +220,14 @@ movn(struct lexer_t *const lexer, uint32_t const n)
     lexer->cur += n;
 }
 
-/* Return non-zero value if the character at the current position in the
-   input source matches C.  */
-static bool
-match(struct lexer_t const *const lexer, char const c)
-{
-    return *lexer->cur == c;
-}
-
 /* Return non-zero value if the character N bytes ahead of the current
    position in LEXER matches C.  */
 static bool
 match_at(struct lexer_t const *const lexer,
                 uint32_t const n, char const c)
 {
-    return lexer->cur[n] != '\0'
-                && lexer->cur[n] == c;
+    return !eof_at(lexer, n)
+                && lexer->cur[n] == (char unsigned) c;
 }
 
 /* Skip any white space at the current position in the input source
@@ -238,28 +235,41 @@ match_at(struct lexer_t const *const lexer,
 static void
 skip_blank(struct lexer_t *const lexer)
 {
-    while (IS_WHITESPACE(*lexer->cur))
-        ++lexer->cur;
+    if (!IS_WHITESPACE(peek(lexer)))
+        return;
+
+    /* Most tokens are separated by a single blank, which is not worth
+       a trip through the vector kernel.  */
+    mov(lexer);
+    if (IS_WHITESPACE(peek(lexer)))
+        lexer->cur = simd_skip_blank(current(lexer), lexer->end);
 }
 
-/* Skip the comment sequence at the current position in the input source
-   of LEXER.  */
 static void
-skip_comment(struct lexer_t *const lexer)
+tstream_push(struct tstream_t *stream, struct token_t token);
+
+/* Skip the body of a comment, starting at the current position in the
+   input source of LEXER, up to and including the closing sequence `*}}'.
+   When the input source ends first, LEXER is left in the comment state
+   with the current position at the last bytes of the body, which may hold
+   the start of the closing sequence; that is where the search goes on once
+   more input arrives (see `lex_feed').  If none will, the comment is an
+   unterminated one, which is pushed onto STREAM as a problem.  */
+static void
+skip_comment_body(struct lexer_t *const lexer,
+                        struct tstream_t *const stream)
 {
-    /* This function expects the current character to be poiting at
-       the first `{' in the comment opening sequence `{{*'; this is
-       the reason why I move 3 bytes forward.   */
-    movn(lexer, 3);
+    char unsigned const *const body = current(lexer);
+
+    lexer->state = LEX_STATE_CODE;
 
     while (!eof(lexer))
     {
-        /* Look for the closing `*' character.  */
-        if (!match(lexer, '*'))
-        {
-            mov(lexer);
-            continue;
-        }
+        /* Jump straight to the next closing `*' candidate.  */
+        lexer->cur = simd_find_star(current(lexer), lexer->end);
+
+        if (eof(lexer))
+            break;
 
         /* If found, check if it is immediately followed by the
           sequence `}}'.  */
@@ -273,25 +283,69 @@ skip_comment(struct lexer_t *const lexer)
         /* Move one byte forward otherwise.  */
         mov(lexer);
     }
+
+    if (lexer->final)
+    {
+        tstream_push(stream, (struct token_t) { .type  = TOK_UNK,
+                                                .flags = DIAG_COMMENT,
+                                                .pos   = (uint32_t) lexer->comment_at });
+        return;
+    }
+
+    lexer->state = LEX_STATE_COMMENT;
+    lexer->cur   = lexer->end - body > 2 ? lexer->end - 2 : body;
+}
+
+/* Skip the comment sequence at the current position in the input source
+   of LEXER.  */
+static void
+skip_comment(struct lexer_t *const lexer,
+                struct tstream_t *const stream)
+{
+    lexer->comment_at = lexer->base + (size_t) (current(lexer) - lexer->buf);
+
+    /* This function expects the current character to be poiting at
+       the first `{' in the comment opening sequence `{{*'; this is
+       the reason why I move 3 bytes forward.   */
+    movn(lexer, 3);
+    skip_comment_body(lexer, stream);
+}
+
+/* Resize the tokens of STREAM from CAP to NEW_CAP with its allocator.  */
+static struct token_t *
+tstream_resize(struct tstream_t const *const stream,
+                    size_t const cap, size_t const new_cap)
+{
+    if (!stream->alloc)
+        return realloc(stream->tokens, new_cap * sizeof(struct token_t));
+
+    return stream->alloc->resize(stream->alloc->ctx, stream->tokens,
+                                 cap * sizeof(struct token_t),
+                                 new_cap * sizeof(struct token_t));
 }
 
-/* Append TOKEN to the end of STREAM.  */
+/* Append TOKEN to the end of STREAM.  If there is no memory left for it,
+   STREAM is marked as failed and TOKEN, and all after it, are dropped.  */
 static void
 tstream_push(struct tstream_t *const stream,
                     struct token_t const token)
 {
+    /* Dropping a token leaves a gap, so no later token goes in.  */
+    if (stream->failed)
+        return;
+
     if (1 + stream->size > stream->capacity)
     {
         size_t const cap = stream->capacity < 8
                                 ? 8 : 2 * stream->capacity;
-        struct token_t *buffer = realloc(stream->tokens,
-                                                cap * sizeof(struct token_t ));
+        struct token_t *buffer = tstream_resize(stream, stream->capacity, cap);
         if (!buffer)
         {
-            perror("Fatal failure");
-            free(stream->tokens);
-            exit(EXIT_FAILURE);
+            stream->failed = true;
+            return;
         }
+        TRACE_COUNT(GROW, (cap - stream->capacity) * sizeof(struct token_t));
+
         stream->tokens = buffer;
         stream->capacity = cap;
     }
@@ -299,34 +353,129 @@ tstream_push(struct tstream_t *const stream,
     stream->tokens[stream->size++] = token;
 }
 
+/* Push a problem of KIND onto STREAM as a TOK_UNK token and move LEN bytes
+   past it in the input source of LEXER, which is where scanning goes on.  */
+static void
+push_unk(struct lexer_t *const lexer,
+            struct tstream_t *const stream,
+            enum lex_diag_kind const kind,
+            uint32_t const len)
+{
+    tstream_push(stream, (struct token_t) { .type = TOK_UNK, .flags = kind });
+    movn(lexer, len);
+}
+
+/* Return where to go on looking for the end of the token that starts at
+   START in the input source of LEXER: past the bytes looked at before the
+   token was held back at the end of the previous chunk, if it was, or
+   START itself.  */
+static char unsigned const *
+resume_at(struct lexer_t const *const lexer,
+            char unsigned const *const start)
+{
+    size_t const at = lexer->base + (size_t) (start - lexer->buf);
+
+    if (lexer->held_at == at && lexer->held_scanned > at)
+        return lexer->buf + (lexer->held_scanned - lexer->base);
+
+    return start;
+}
+
+/* Remember that the end of the token that starts at START in the input
+   source of LEXER is not among the bytes up to the end of the chunk.  */
+static void
+hold(struct lexer_t *const lexer,
+        char unsigned const *const start)
+{
+    lexer->held_at      = lexer->base + (size_t) (start - lexer->buf);
+    lexer->held_scanned = lexer->base + (size_t) (lexer->end - lexer->buf);
+}
+
+void
+tstream_reset(struct tstream_t *const stream)
+{
+    stream->size   = 0;
+    stream->failed = false;
+}
+
+void
+tstream_free(struct tstream_t *const stream)
+{
+    if (!stream->alloc)
+        free(stream->tokens);
+    else if (stream->tokens)
+        stream->alloc->release(stream->alloc->ctx, stream->tokens,
+                               stream->capacity * sizeof(struct token_t));
+
+    *stream = (struct tstream_t) { .alloc = stream->alloc };
+}
+
+/* Return the first `"' from P on, before END, that closes the string whose
+   text starts at OPEN, or a null pointer if there is none.  A `"' after an
+   odd run of backslashes is escaped, so it is part of the text.  */
+static char unsigned const *
+find_close_quote(char unsigned const *const open,
+                    char unsigned const *p,
+                    char unsigned const *const end)
+{
+    while (p < end)
+    {
+        char unsigned const *const quote = memchr(p, '"', (size_t) (end - p));
+        if (!quote)
+            return nullptr;
+
+        char unsigned const *run = quote;
+        while (run > open && '\\' == run[-1])
+            --run;
+
+        if (0 == (quote - run) % 2)
+            return quote;
+
+        p = quote + 1;
+    }
+
+    return nullptr;
+}
+
 /* Scan a string at the current position in the input source of LEXER
-   and push it onto STREAM.  */
-[[nodiscard]]
-static int
+   and push it onto STREAM.  Escape sequences are kept as they are in its
+   text.  */
+static void
 lex_string(struct lexer_t *const lexer,
                 struct tstream_t *const stream)
 {
     struct token_t tok = { .type = TOK_STRING };
 
-    /* The token we are going to lex should start here.  */
-    mov(lexer); /* Skip opening `"'.  */
-    tok.val.text.str = current(lexer);
+    char unsigned const *const open  = current(lexer) + 1;
+    char unsigned const *const from  = resume_at(lexer, current(lexer));
+    char unsigned const *const close = find_close_quote(open, from > open ? from : open,
+                                                        lexer->end);
 
-    while (!eof(lexer) && !match(lexer, '"'))
+    /* A string that is not closed by the end of a chunk may still be by
+       the next one; otherwise, the opening `"' is all that is wrong.  */
+    if (!close)
     {
-        ++tok.val.text.len;
-        mov(lexer);
+        if (lexer->final)
+            push_unk(lexer, stream, DIAG_STRING, 1);
+        else
+        {
+            hold(lexer, current(lexer));
+            lexer->cur = lexer->end;
+        }
+
+        return;
     }
 
-    mov(lexer); /* Skip closing `"'.  */
+    tok.val.text.str = open;
+    tok.val.text.len = (size_t) (close - open);
+    lexer->cur       = close + 1;
+
     tstream_push(stream, tok);
-    return 0;
 }
 
 /* Scan an identifier at the current position in the input source of LEXER
    and push it onto STREAM.  */
-[[nodiscard]]
-static int
+static void
 lex_identifier(struct lexer_t *const lexer,
                     struct tstream_t *const stream)
 {
@@ -347,67 +496,333 @@ lex_identifier(struct lexer_t *const lexer,
     //     continue;
     // }
 
-    size_t offset;
-    char32_t c32;
-    mbstate_t st1 = {0};
+    char unsigned const *p         = current(lexer);
+    char unsigned const *const end = lexer->end;
     struct token_t tok = { .type = TOK_NAME };
-    tok.val.text.str = current(lexer);
+    tok.val.text.str = p;
+
+    /* The symbol table hash is computed on the fly, while the bytes are
+       still at hand.  */
+    uint32_t hash = SYM_HASH_INIT;
 
     /* Keep lexing the identifier.  */
-    for (;;)
+    while (p < end)
     {
-        offset = mbrtoc32(&c32, (char const *) current(lexer), SIZE_MAX, &st1);
-        if (!IS_IDENTIFIER(c32) && !isdigit(peek(lexer)))
+        /* Plain ASCII needs no decoding at all.  */
+        if (*p < 0x80)
+        {
+            if (!IS_WORD(*p))
+                break;
+
+            hash = SYM_HASH_STEP(hash, *p);
+            ++p;
+            continue;
+        }
+
+        char32_t c32;
+        size_t const offset = lexer->trusted ? utf8_decode_trusted(&c32, p)
+                                             : utf8_decode_multi(&c32, p, end);
+
+        TRACE_COUNT(DECODE, 0);
+        if (UTF8_INVALID == offset || UTF8_TRUNCATED == offset
+            || !IS_IDENTIFIER_REST(c32))
         {
             /* Character found is not valid to be part of an identifier.  */
             break;
         }
 
-        movn(lexer, (uint32_t)offset);
-        tok.val.text.len += offset;
+        for (size_t i = 0; i < offset; ++i)
+            hash = SYM_HASH_STEP(hash, p[i]);
+
+        p += offset;
+    }
+
+    tok.val.text.len = (size_t) (p - tok.val.text.str);
+    lexer->cur = p;
+
+    /* Keywords are told apart from names by the hash just computed.  */
+    struct keyword const *const kw = &keywords[KW_SLOT(hash)];
+
+    if (kw->hash == hash && kw->len == tok.val.text.len
+            && 0 == memcmp(kw->spelling, tok.val.text.str, kw->len))
+    {
+        /* Their spelling is fixed by their type, like that of operators.  */
+        tok = (struct token_t) { .type = kw->id };
     }
+    else if (lexer->symtab)
+        tok.sym = symtab_intern(lexer->symtab, tok.val.text.str, tok.val.text.len, hash);
 
     tstream_push(stream, tok);
-    return 0;
+}
+
+/* Return the value of the hexadecimal digit C, or 16 if C is none.  */
+static inline unsigned
+digit_value(char unsigned const c)
+{
+    if (IS_DIGIT(c))
+        return (unsigned) (c - '0');
+
+    char unsigned const lower = c | 0x20;
+    if (lower >= 'a' && lower <= 'f')
+        return (unsigned) (lower - 'a' + 10);
+
+    return 16;
+}
+
+/* Return the eight bytes at P as a little-endian word.  */
+static inline uint64_t
+load_le64(char unsigned const *const p)
+{
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+
+    return word;
+}
+
+/* Return non-zero value if all the bytes of the word W are ASCII decimal
+   digits.  A byte below `0' borrows, and one above `9' carries, into its
+   top bit.  */
+#define SWAR_IS_DIGITS( w ) \
+    ( 0 == ( ( ( ( w ) + UINT64_C(0x4646464646464646) ) \
+               | ( ( w ) - UINT64_C(0x3030303030303030) ) ) \
+             & UINT64_C(0x8080808080808080) ) )
+
+/* Return the value of the eight decimal digits in the word W, loaded with
+   `load_le64', the first digit being the most significant.  Adjacent
+   digits are combined in pairs, then the pairs in pairs, and so on, with
+   three multiplications in all.  */
+static inline uint32_t
+swar_parse_digits(uint64_t w)
+{
+    w -= UINT64_C(0x3030303030303030);
+    w  = w * 10 + (w >> 8);
+    w  = ( ( w & UINT64_C(0x000000FF000000FF) ) * UINT64_C(0x000F424000000064)
+           + ( ( w >> 16 ) & UINT64_C(0x000000FF000000FF) ) * UINT64_C(0x0000271000000001) ) >> 32;
+
+    return (uint32_t) w;
+}
+
+/* Skip the digits in base BASE at P, which may be grouped with an
+   underscore between two of them, and return where they end.  */
+static char unsigned const *
+skip_digits(char unsigned const *p, char unsigned const *const end, unsigned const base)
+{
+    while (p < end)
+    {
+        if (digit_value(*p) < base)
+            ++p;
+        else if ('_' == *p && p + 1 < end && digit_value(p[1]) < base)
+            p += 2;
+        else
+            break;
+    }
+
+    return p;
+}
+
+/* Store VALUE in the number token TOK, unless OVERFLOW is set or it is too
+   large anyway.  */
+static void
+set_integer(struct token_t *const tok, uint64_t const value, bool overflow)
+{
+    if (value > (uint64_t) INT64_MAX)
+        overflow = true;
+
+    tok->flags |= TOK_NUM_INT | (overflow ? TOK_NUM_OVERFLOW : 0);
+    tok->ival   = overflow ? INT64_MAX : (int64_t) value;
+}
+
+/* Scan the number at P, which ends before END, and return where it ends.
+   Store its value in TOK.
+
+   A number is either an integer in base 16, 2 or 8, introduced by `0x',
+   `0b' or `0o' (or in capitals), or a decimal number with an optional
+   fraction and exponent.  Leading zeros make no octal number, unlike in
+   C: `0755' is 755.  Digits may be grouped with underscores, each of which
+   must be followed by a digit.  Whatever does not fit, such as an `x' not
+   followed by a hexadecimal digit, is left for the next token.  */
+static char unsigned const *
+scan_number(char unsigned const *p,
+                char unsigned const *const end,
+                struct token_t *const tok)
+{
+    char unsigned const *const start    = p;
+    uint64_t                   value    = 0;
+    bool                       overflow = false;
+
+    /* Integers with a base prefix.  */
+    if (end - p >= 3 && '0' == p[0])
+    {
+        char unsigned const prefix = p[1] | 0x20;
+        unsigned const      shift  = 'x' == prefix ? 4 : 'o' == prefix ? 3 : 'b' == prefix ? 1 : 0;
+
+        if (0 != shift && digit_value(p[2]) < 1u << shift)
+        {
+            for (p += 2; p < end; ++p)
+            {
+                unsigned const d = digit_value(*p);
+
+                if (d >= 1u << shift)
+                {
+                    if ('_' == *p && p + 1 < end && digit_value(p[1]) < 1u << shift)
+                        continue;
+
+                    break;
+                }
+
+                if (value > (uint64_t) INT64_MAX >> shift)
+                    overflow = true;
+                else
+                    value = value << shift | d;
+            }
+
+            set_integer(tok, value, overflow);
+            return p;
+        }
+    }
+
+    /* Integer part, eight digits at a time while it lasts.  */
+    while (p < end)
+    {
+        if (end - p >= 8)
+        {
+            uint64_t const word = load_le64(p);
+
+            if (SWAR_IS_DIGITS(word))
+            {
+                overflow |= ckd_mul(&value, value, UINT64_C(100000000))
+                                || ckd_add(&value, value, swar_parse_digits(word));
+                p += 8;
+                continue;
+            }
+        }
+
+        if (IS_DIGIT(*p))
+        {
+            overflow |= ckd_mul(&value, value, UINT64_C(10))
+                            || ckd_add(&value, value, (uint64_t) (*p - '0'));
+            ++p;
+        }
+        else if ('_' == *p && p + 1 < end && IS_DIGIT(p[1]))
+            ++p;
+        else
+            break;
+    }
+
+    bool real   = false;
+    bool digits = p > start;
+
+    /* Fraction.  */
+    if (p < end && '.' == *p)
+    {
+        char unsigned const *const point = p;
+
+        real    = true;
+        p       = skip_digits(p + 1, end, 10);
+        digits |= p > point + 1;
+    }
+
+    /* Exponent, which is only one if digits come before and after.  */
+    if (digits && p < end && 'e' == (*p | 0x20))
+    {
+        char unsigned const *q = p + 1;
+
+        if (q < end && ('+' == *q || '-' == *q))
+            ++q;
+
+        if (q < end && IS_DIGIT(*q))
+        {
+            real = true;
+            p    = skip_digits(q, end, 10);
+        }
+    }
+
+    /* A lone `.' is no number at all.  */
+    if (!digits)
+        return p;
+
+    if (real)
+    {
+        tok->fval   = parse_real(start, p, &overflow);
+        tok->flags |= TOK_NUM_REAL | (overflow ? TOK_NUM_OVERFLOW : 0);
+        return p;
+    }
+
+    set_integer(tok, value, overflow);
+    return p;
 }
 
 /* Scan a number at the current position in the input source of LEXER and
-  push it onto STREAM.  The scanned token is distinguished is between a
-  decimal, hexadecimal, octal and binary number.  */
-[[nodiscard]]
-static int
+   push it onto STREAM.  See `scan_number'.  */
+static void
 lex_number(struct lexer_t *const lexer,
                 struct tstream_t *const stream)
 {
-    /* True means the number being parsed has encounter a decimal point.
-       This flag helps know when to stop searching for a decimal point.  */
-    uint8_t point_count = 0;
     struct token_t tok = { .type = TOK_NUMBER };
+
     tok.val.text.str = current(lexer);
+    lexer->cur       = scan_number(current(lexer), lexer->end, &tok);
+    tok.val.text.len = (size_t) (current(lexer) - tok.val.text.str);
+
+    tstream_push(stream, tok);
+}
+
+/* Scan the arguments of a meta-command at the current position in the
+   input source of LEXER, which take all of the rest of it, and push them
+   onto STREAM.  Arguments are separated by white space, unless quoted.
+
+   When more input may follow, LEXER is left among the arguments, at the
+   start of the last one if it may still go on; the bytes of it that were
+   looked at are not looked at again once the next chunk arrives.  */
+static void
+lex_cmd_args(struct lexer_t *const lexer,
+                struct tstream_t *const stream)
+{
+    lexer->state = LEX_STATE_CODE;
 
-    while (isdigit(peek(lexer)) || match(lexer, '.'))
+    while (true)
     {
-        if (match(lexer, '.'))
-            ++point_count;
+        while (!eof(lexer) && IS_WHITESPACE(peek(lexer)))
+            mov(lexer);
+
+        if (eof(lexer))
+            break;
+
+        /* A quoted argument ends at either quote, which is part of it.  */
+        char unsigned const *const start  = current(lexer);
+        bool const                 quoted = '"' == *start || '\'' == *start;
+        char unsigned const       *p      = resume_at(lexer, start);
+
+        if (quoted && p == start)
+            ++p;
 
-        if (point_count > 1)
+        while (p < lexer->end && (quoted ? '"' != *p && '\'' != *p : !IS_WHITESPACE(*p)))
+            ++p;
+
+        if (p == lexer->end && !lexer->final)
         {
+            hold(lexer, start);
             break;
         }
 
-        ++tok.val.text.len;
-        mov(lexer);
+        if (quoted && p < lexer->end)
+            ++p;
+
+        tstream_push(stream, (struct token_t) {
+            .type = TOK_CMD_ARG,
+            .pos  = offset_of(lexer, start),
+            .val.text = { .str = start, .len = (size_t) (p - start) },
+        });
 
-        /* For cases such as `.a', when the character after the . is not a digit.  */
-        // if (1 == point_count && !isdigit(peek(lexer)) && 0 == lexer->lxm_size)
-        // {
-        //     lxm_reset(lexer);
-        //     return (size_t)-1;
-        // }
+        lexer->cur = p;
     }
 
-    tstream_push(stream, tok);
-    return 0;
+    if (!lexer->final)
+        lexer->state = LEX_STATE_COMMAND;
 }
 
 /* Scan a  meta-command and  its arguments  (if any) and push them onto
@@ -431,14 +846,14 @@ lex_number(struct lexer_t *const lexer,
              ,---> T_CMD            ,---> T_CMDARG         ,---> T_CMDARG
         \exec  -f "/path/to/file.lxm" -f /path/to/file2.lxm
                 `---> T_CMDARG         `---> T_CMDARG       */
-static size_t
+static void
 lex_cmd(struct lexer_t *const lexer,
             struct tstream_t *const stream)
 {
     if (eof_at(lexer, 1) || IS_WHITESPACE(peek_at(lexer, 1)))
     {
-        // error = true; /* unknown command  */
-        return (size_t)-1;
+        push_unk(lexer, stream, DIAG_CMD, 1);
+        return;
     }
 
     /* Parse command name.  */
@@ -446,6 +861,7 @@ lex_cmd(struct lexer_t *const lexer,
     struct token_t cmd = { .type = TOK_CMD };
     cmd.val.text.str = current(lexer);
     mov(lexer);
+    ++cmd.val.text.len; /* Count the leading `\'.  */
 
     while (!IS_WHITESPACE(peek(lexer)) && !eof(lexer))
     {
@@ -453,368 +869,1266 @@ lex_cmd(struct lexer_t *const lexer,
         ++cmd.val.text.len;
     }
 
-    tstream_push(stream, cmd);
+    /* The name may still go on in the next chunk.  */
+    if (eof(lexer) && !lexer->final)
+        return;
 
-    /* Parse command arguments (if any).  */
+    tstream_push(stream, cmd);
+    lex_cmd_args(lexer, stream);
+}
 
-    /* Skip any white space in is between the command arguments.  */
-    while (IS_WHITESPACE(peek(lexer)))
-        mov(lexer);
+/* Store in TOK which built-in constant its text, whose symbol table hash
+   is HASH, names, or flag it as unknown.  */
+static inline void
+resolve_const(struct token_t *const tok, uint32_t const hash)
+{
+    struct constant const *const c = &constants[CONST_SLOT(hash)];
 
-    /* If end of string, then we exit.  */
-    if (eof(lexer))
-        return 0;
+    if (c->hash == hash && c->len == tok->val.text.len
+            && 0 == memcmp(c->spelling, tok->val.text.str, c->len))
+        tok->cid = c->id;
+    else
+        tok->flags |= TOK_CONST_UNKNOWN;
+}
 
-    /* As long as we are not at the end of the string,
-      then we are free to scan arguments.  */
-    while (!eof(lexer))
+/* Scan a constant object and push it onto STREAM.  Constant values start
+   with a `$' to differentiate them from a regular identifiers and reserved
+   words.  The built-in ones, such as `$PI' or `$SQRT1_2', are listed in
+   LEX_CONSTS_TABLE; which one a token names is found out right away, so
+   its value is at hand through `lex_const_value'.  */
+static void
+lex_const(struct lexer_t *const lexer,
+                struct tstream_t *const stream)
+{
+    /* Check if the next byte after `$' is a valid character.
+       It should be any of [0-9a-zA-Z_], otherwise the constant
+       is ill-formed.  */
+    if (eof_at(lexer, 1) || !IS_WORD(peek_at(lexer, 1)))
     {
-        /* These arguments are expected to be separated by white spaces,
-           so if any is found,  we must skip it until we find a parsable
-           token.  */
-        while (IS_WHITESPACE(peek(lexer)))
-            mov(lexer);
+        push_unk(lexer, stream, DIAG_CONST, 1);
+        return;
+    }
 
-        struct token_t arg = { .type = TOK_CMD_ARG };
-        arg.val.text.str = current(lexer);
+    struct token_t tok = { .type = TOK_CONST };
+    tok.val.text.str = current(lexer);
+    mov(lexer);
 
-        /* Check if current pointer is the beginning of a string; in such case,
-           then we need to parse the remaining values as the are until finding
-           the closing string character. */
-        if (match(lexer, '"') || match(lexer, '\''))
-        {
-            mov(lexer);
-            ++arg.val.text.len;
-            while (!eof(lexer) && !match(lexer, '"') && !match(lexer, '\''))
-            {
-                mov(lexer);
-                ++arg.val.text.len;
-            }
+    /* The `$' is part of the symbol, which keeps constants apart from
+       names.  */
+    uint32_t hash = SYM_HASH_STEP(SYM_HASH_INIT, '$');
 
-            mov(lexer);
-            ++arg.val.text.len;
-            tstream_push(stream, arg);
-            continue;
+    ++tok.val.text.len;
+    while (IS_WORD(peek(lexer)))
+    {
+        hash = SYM_HASH_STEP(hash, peek(lexer));
+        mov(lexer);
+        ++tok.val.text.len;
+    }
+
+    resolve_const(&tok, hash);
+
+    if (lexer->symtab)
+        tok.sym = symtab_intern(lexer->symtab, tok.val.text.str, tok.val.text.len, hash);
+
+    tstream_push(stream, tok);
+}
+
+double
+lex_const_value(enum lex_const const id)
+{
+    static double const values[MAX_CONSTS] = {
+        [CONST_NONE] = (double) NAN,
+#define CONST( name, value ) [CONST_ ## name] = value,
+        LEX_CONSTS_TABLE
+#undef CONST
+    };
+
+    return values[id < MAX_CONSTS ? id : CONST_NONE];
+}
+
+char const *
+lex_diag_message(enum lex_diag_kind const kind)
+{
+    static char const *const messages[MAX_DIAGS] = {
+        [DIAG_NONE] = "no problem",
+#define DIAG( name, message ) [DIAG_ ## name] = message,
+        LEX_DIAGS_TABLE
+#undef DIAG
+    };
+
+    return messages[kind < MAX_DIAGS ? kind : DIAG_NONE];
+}
+
+/* Most bytes past the end of a token that are examined to decide that the
+   token ends there: a whole multibyte character after a name.  */
+#define LEX_LOOKAHEAD  4
+
+/* Outcome of scanning one token with `lex_token'.  */
+enum lex_status : unsigned char
+{
+    LEX_OK,     /* A token was scanned or a comment skipped.  */
+    LEX_EOF,    /* Only white space was left.  */
+    LEX_ERROR   /* Nothing could be scanned, which should never happen.  */
+};
+
+/* Return the length of the longest operator at P, before END, and store
+   its type in TYPE, or return zero if there is none.  Multibyte operators
+   are matched on their bytes, without decoding them.  */
+static inline size_t
+match_operator(char unsigned const *const p,
+                    char unsigned const *const end,
+                    enum token_type *const type)
+{
+    unsigned state = OP_START;
+    size_t   len   = 0;
+
+    for (size_t i = 0; p + i < end; ++i)
+    {
+        state = op_next[state][op_class[p[i]]];
+        if (OP_DEAD == state)
+            break;
+
+        if (MAX_TOKENS != op_accept[state])
+        {
+            *type = op_accept[state];
+            len   = i + 1;
         }
+    }
 
-        /* If end of string, then we exit.  */
-        if (eof(lexer))
-            continue;
+    return len;
+}
+
+/* Scan the longest operator at the current position in the input source
+   of LEXER and push it onto STREAM, or a stray byte if there is none.  */
+static enum lex_status
+lex_operator(struct lexer_t *const lexer,
+                struct tstream_t *const stream)
+{
+    enum token_type type = TOK_UNK;
+    size_t const    len  = match_operator(current(lexer), lexer->end, &type);
+
+    if (0 == len)
+    {
+        push_unk(lexer, stream, DIAG_STRAY, 1);
+        return LEX_OK;
+    }
+
+    tstream_push(stream, (struct token_t) { .type = type });
+    movn(lexer, (uint32_t) len);
+    return LEX_OK;
+}
+
+/* The first byte of a token tells which sub-lexer scans it (see
+   `scan_classes').  Where the compiler supports taking the address of a
+   label, `lex_scan' jumps straight to it through a table; elsewhere, a
+   switch does the same.  */
+#ifndef LEX_COMPUTED_GOTO
+#  if defined(__GNUC__) || defined(__clang__)
+#    define LEX_COMPUTED_GOTO  1
+#  else
+#    define LEX_COMPUTED_GOTO  0
+#  endif
+#endif
+
+#if LEX_COMPUTED_GOTO
+#  define SCAN_DISPATCH( class )  goto *scan_targets[( class )];
+#  define SCAN_CASE( class )      scan_ ## class
+#else
+#  define SCAN_DISPATCH( class )  switch ( class )
+#  define SCAN_CASE( class )      case SCAN_ ## class
+#endif
+
+#if LEX_COMPUTED_GOTO
+#  pragma GCC diagnostic push
+#  pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+/* Scan the token at the current position in the input source of LEXER,
+   which is not white space, and push it onto STREAM.  A meta-command is
+   scanned along with all of its arguments.  */
+static enum lex_status
+lex_scan(struct lexer_t *const lexer,
+                struct tstream_t *const stream)
+{
+#if LEX_COMPUTED_GOTO
+    static void *const scan_targets[SCAN_CLASSES] = {
+        [SCAN_OTHER]     = &&scan_OTHER,
+        [SCAN_NAME]      = &&scan_NAME,
+        [SCAN_NUMBER]    = &&scan_NUMBER,
+        [SCAN_DOT]       = &&scan_DOT,
+        [SCAN_BRACE]     = &&scan_BRACE,
+        [SCAN_OPERATOR]  = &&scan_OPERATOR,
+        [SCAN_STRING]    = &&scan_STRING,
+        [SCAN_CONST]     = &&scan_CONST,
+        [SCAN_CMD]       = &&scan_CMD,
+        [SCAN_MULTIBYTE] = &&scan_MULTIBYTE,
+    };
+#endif
+
+    SCAN_DISPATCH(scan_classes[peek(lexer)])
+    {
+    SCAN_CASE(NAME):
+        TRACE_SCAN(NAME, lexer, stream, lex_identifier(lexer, stream));
+        return LEX_OK;
 
-        /* At this point we have found a valid argument.  */
-        while (!IS_WHITESPACE(peek(lexer)) && !eof(lexer))
+    SCAN_CASE(NUMBER):
+        TRACE_SCAN(NUMBER, lexer, stream, lex_number(lexer, stream));
+        return LEX_OK;
+
+    SCAN_CASE(OPERATOR):
+    {
+        enum lex_status status;
+        TRACE_SCAN(OPERATOR, lexer, stream, status = lex_operator(lexer, stream));
+        return status;
+    }
+
+    SCAN_CASE(DOT):
+    {
+        /* A `.' on its own is a number, as are `.5' and the like.  */
+        enum token_type type;
+        size_t const    len = match_operator(current(lexer), lexer->end, &type);
+
+        if (0 == len)
         {
-            mov(lexer);
-            ++arg.val.text.len;
+            TRACE_SCAN(NUMBER, lexer, stream, lex_number(lexer, stream));
+            return LEX_OK;
         }
 
-        tstream_push(stream, arg);
+        TRACE_SCAN(OPERATOR, lexer, stream,
+                   tstream_push(stream, (struct token_t) { .type = type });
+                   movn(lexer, (uint32_t) len));
+        return LEX_OK;
     }
 
-    return 0;
+    SCAN_CASE(BRACE):
+    {
+        if (match_at(lexer, 1, '{') && match_at(lexer, 2, '*'))
+        {
+            TRACE_SCAN(COMMENT, lexer, stream, skip_comment(lexer, stream));
+            return LEX_OK;
+        }
+
+        enum lex_status status;
+        TRACE_SCAN(OPERATOR, lexer, stream, status = lex_operator(lexer, stream));
+        return status;
+    }
+
+    SCAN_CASE(STRING):
+        TRACE_SCAN(STRING, lexer, stream, lex_string(lexer, stream));
+        return LEX_OK;
+
+    SCAN_CASE(CONST):
+        TRACE_SCAN(CONST, lexer, stream, lex_const(lexer, stream));
+        return LEX_OK;
+
+    SCAN_CASE(CMD):
+        TRACE_SCAN(CMD, lexer, stream, lex_cmd(lexer, stream));
+        return LEX_OK;
+
+    SCAN_CASE(MULTIBYTE):
+    {
+        /* Operators come before names, so that `Ø' is the empty set, and
+           are matched without decoding them.  */
+        enum token_type type;
+        size_t const    len = match_operator(current(lexer), lexer->end, &type);
+
+        if (len > 0)
+        {
+            TRACE_SCAN(OPERATOR, lexer, stream,
+                       tstream_push(stream, (struct token_t) { .type = type });
+                       movn(lexer, (uint32_t) len));
+            return LEX_OK;
+        }
+
+        /* The decoder does not depend on the process locale.  */
+        char32_t     c32;
+        size_t const offset = lexer->trusted ? utf8_decode_trusted(&c32, current(lexer))
+                                             : utf8_decode(&c32, current(lexer), lexer->end);
+
+        TRACE_COUNT(DECODE, 0);
+
+        /* Invalid or truncated input goes along with the bytes that look
+           like they continue it.  */
+        if (offset == UTF8_INVALID || offset == UTF8_TRUNCATED)
+        {
+            uint32_t bad = 1;
+            while (bad < 4 && !eof_at(lexer, bad) && UTF8_IS_CONT(peek_at(lexer, bad)))
+                ++bad;
+
+            TRACE_SCAN(OTHER, lexer, stream, push_unk(lexer, stream, DIAG_UTF8, bad));
+            return LEX_OK;
+        }
+
+        if (IS_IDENTIFIER(c32))
+        {
+            TRACE_SCAN(NAME, lexer, stream, lex_identifier(lexer, stream));
+            return LEX_OK;
+        }
+
+        TRACE_SCAN(OTHER, lexer, stream, push_unk(lexer, stream, DIAG_STRAY, 1));
+        return LEX_OK;
+    }
+
+    SCAN_CASE(OTHER):
+        TRACE_SCAN(OTHER, lexer, stream, push_unk(lexer, stream, DIAG_STRAY, 1));
+        return LEX_OK;
+    }
+
+    unreachable();
 }
 
-/* Scan a constant object and push it onto STREAM.  Constant values start
-   with a `$' to differentiate them from a regular identifiers and reserved
-   words.  Examples of constants:
-
-        $E           2.7182818284590452354     {{* e          *}}
-        $LOG2E       1.4426950408889634074     {{* log_2 e    *}}
-        $LOG10E      0.43429448190325182765    {{* log_10 e   *}}
-        $LN2         0.69314718055994530942    {{* log_e 2    *}}
-        $LN10        2.30258509299404568402    {{* log_e 10   *}}
-        $PI          3.14159265358979323846    {{* pi         *}}
-        $PI_2        1.57079632679489661923    {{* pi/2       *}}
-        $PI_4        0.78539816339744830962    {{* pi/4       *}}
-        $1_PI        0.31830988618379067154    {{* 1/pi       *}}
-        $2_PI        0.63661977236758134308    {{* 2/pi       *}}
-        $2_SQRTPI    1.12837916709551257390    {{* 2/sqrt(pi) *}}
-        $SQRT2       1.41421356237309504880    {{* sqrt(2)    *}}
-        $SQRT1_2     0.70710678118654752440    {{* 1/sqrt(2)  *}}  */
-static int
-lex_const(struct lexer_t *const lexer,
+#if LEX_COMPUTED_GOTO
+#  pragma GCC diagnostic pop
+#endif
+
+#undef SCAN_DISPATCH
+#undef SCAN_CASE
+
+/* Return true if the offsets of the input source of LEXER, up to and
+   including that of its end, do not all fit in `pos'.  */
+static inline bool
+too_large(struct lexer_t const *const lexer)
+{
+    return lexer->base + (size_t) (lexer->end - lexer->buf) > UINT32_MAX;
+}
+
+/* Scan the token at the current position in the input source of LEXER, after
+   any white space, and push it onto STREAM along with its position.
+
+   Deciding where a token ends never takes more than `LEX_LOOKAHEAD' bytes
+   past it; `lex_feed' relies on that to tell whether a token that ends near
+   the end of a chunk is really complete.  A string that is not closed
+   within the chunk takes all of it instead, so it is scanned again too,
+   though only from where the search for its end stopped.  */
+static enum lex_status
+lex_token(struct lexer_t *const lexer,
                 struct tstream_t *const stream)
 {
-    /* Check if the next byte after `$' is a valid character.
-       It should be any of [0-9a-zA-Z_], otherwise the constant
-       is ill-formed.  */
-    if (eof_at(lexer, 1) || (!isalnum(peek_at(lexer, 1)) && !match_at(lexer, 1, '_')))
+    /* Skip any white space before the next token, if any.  */
+    TRACE_SCAN(BLANK, lexer, stream, skip_blank(lexer));
+
+    /* Exit execution flow if pointer is at end of file.  */
+    if (eof(lexer))
+        return LEX_EOF;
+
+    size_t const               first  = stream->size;
+    char unsigned const *const start  = current(lexer);
+    enum lex_status            status = lex_scan(lexer, stream);
+
+    /* A scan that consumes nothing would be repeated forever.  */
+    if (LEX_OK == status && current(lexer) == start)
+        status = LEX_ERROR;
+
+    /* The first token starts right here; any other one is an argument of
+       a meta-command, which starts with its text.  */
+    if (first < stream->size)
     {
-        // error = true; /* malformed constant  */
-        return -1;
+        stream->tokens[first].pos = offset_of(lexer, start);
+
+        for (size_t i = first + 1; i < stream->size; ++i)
+            stream->tokens[i].pos = offset_of(lexer, stream->tokens[i].val.text.str);
     }
 
-    struct token_t tok = { .type = TOK_CONST };
-    tok.val.text.str = current(lexer);
-    mov(lexer);
+    return status;
+}
 
-    ++tok.val.text.len;
-    while (isalnum(peek(lexer)) || match(lexer, '_'))
+/* Record the problems among the tokens of STREAM from FROM on in the side
+   table of LEXER, if it has one.  */
+static void
+record_diags(struct lexer_t const *const lexer,
+                struct tstream_t const *const stream,
+                size_t const from)
+{
+    struct lex_diags_t *const diags = lexer->diags;
+
+    if (!diags || diags->failed)
+        return;
+
+    for (size_t i = from; i < stream->size; ++i)
     {
-        mov(lexer);
-        ++tok.val.text.len;
+        struct token_t const *const tok = &stream->tokens[i];
+
+        if (TOK_UNK != tok->type)
+            continue;
+
+        if (diags->size == diags->capacity)
+        {
+            size_t const cap = diags->capacity < 16 ? 16 : 2 * diags->capacity;
+
+            struct lex_diag_t *const items = realloc(diags->items, cap * sizeof(struct lex_diag_t));
+            if (!items)
+            {
+                diags->failed = true;
+                return;
+            }
+
+            diags->items    = items;
+            diags->capacity = cap;
+        }
+
+        diags->items[diags->size++] = (struct lex_diag_t) { .pos  = tok->pos,
+                                                            .kind = tok->flags };
     }
+}
 
-    tstream_push(stream, tok);
-    return 0;
+/* Scan the input source of LEXER token after token, pushing them onto STREAM.
+   Unless FINAL is set, more input may follow, so scanning stops before any
+   token that could still go on in the next chunk, leaving it at the current
+   position of LEXER.  */
+static void
+lex_run(struct lexer_t *const lexer,
+            struct tstream_t *const stream,
+            bool const final)
+{
+    size_t const from = stream->size;
+
+    lexer->final = final;
+
+    if (LEX_STATE_COMMENT == lexer->state)
+        TRACE_SCAN(COMMENT, lexer, stream, skip_comment_body(lexer, stream));
+    else if (LEX_STATE_COMMAND == lexer->state)
+        TRACE_SCAN(CMD, lexer, stream, lex_cmd_args(lexer, stream));
+
+    while (LEX_STATE_CODE == lexer->state)
+    {
+        char unsigned const *const start = current(lexer);
+        size_t const               size  = stream->size;
+        enum lex_status const      status = lex_token(lexer, stream);
+
+        if (LEX_EOF == status || LEX_STATE_CODE != lexer->state)
+            break;
+
+        /* Too close to the end of the chunk to tell; scan it again once
+           the next chunk arrives.  This also covers a multibyte character
+           cut by the end of the chunk.  */
+        if (!final && (size_t) (lexer->end - current(lexer)) < LEX_LOOKAHEAD)
+        {
+            stream->size = size;
+            lexer->cur   = start;
+            break;
+        }
+
+        if (LEX_ERROR == status)
+            lexer->state = LEX_STATE_HALTED;
+    }
+
+    record_diags(lexer, stream, from);
 }
 
-void
+int
 lex_start(struct lexer_t *const lexer,
                 struct tstream_t *stream)
 {
-    /* A boolean flag indicating that the lexing went wrong.  */
-    bool error = false;
-    (void)error;
+    if (too_large(lexer))
+        return -1;
 
-    /* State dumb variable for repeated calls to `mbrtoc32'.  */
-    mbstate_t st1 = {0};
+    lex_run(lexer, stream, true);
+    tstream_push(stream, (struct token_t) { .type = TOK_END,
+                                            .pos  = offset_of(lexer, lexer->end) });
 
-    /* Start scanning input.  */
-    while (!eof(lexer))
+    return stream->failed ? -1 : 0;
+}
+
+/* Point the text of TOKEN, which starts at its `pos', into the input source
+   of LEXER.  Strings start past their opening quote.  */
+static void
+rebase_text(struct lexer_t const *const lexer,
+                struct token_t *const token)
+{
+    if (TOK_HAS_TEXT(token->type))
+        token->val.text.str = lexer->buf + (token->pos - lexer->base) + (TOK_STRING == token->type);
+}
+
+int
+lex_relex(struct lexer_t *const lexer,
+                struct tstream_t *const stream,
+                size_t const offset,
+                size_t const old_len,
+                size_t const new_len)
+{
+    struct token_t *tokens = stream->tokens;
+    size_t const    n      = stream->size;
+
+    if (too_large(lexer))
+        return -1;
+
+    /* Not even the end was scanned.  */
+    if (0 == n)
+        return lex_start(lexer, stream);
+
+    /* Deciding where a token ends takes no more than `LEX_LOOKAHEAD' bytes
+       past it, so the edit cannot affect the tokens before the first one
+       that starts less than that before it.  That one is scanned again,
+       unless it is the argument of a meta-command, which are scanned along
+       with the command.  */
+    size_t lo = 1;
+    size_t hi = n;
+
+    while (lo < hi)
     {
-        /* Skip any white space before the next token, if any.  */
-        skip_blank(lexer);
+        size_t const mid = lo + (hi - lo) / 2;
 
-        /* Exit execution flow if pointer is at end of file.  */
-        if (eof(lexer))
+        if (tokens[mid].pos + LEX_LOOKAHEAD <= offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    size_t keep = lo - 1;
+    while (keep > 0 && TOK_CMD_ARG == tokens[keep].type)
+        --keep;
+
+    /* Whether a string or a comment goes unterminated turns on all of the
+       source past it, so the edit can affect that one as well.  */
+    for (size_t i = 0; i < keep; ++i)
+    {
+        if (TOK_UNK == tokens[i].type
+            && (DIAG_STRING == tokens[i].flags || DIAG_COMMENT == tokens[i].flags))
+        {
+            keep = i;
             break;
+        }
+    }
 
-        /* Reset memory for the next token to be scanned and parsed.  */
-        // lxm_reset(lexer);
+    size_t const start = keep > 0 ? tokens[keep].pos : lexer->base;
 
-        /* Amount of read bytes from the multibyte string.
-           Its value will be added at the end of each
-           iteration to jump exactly the read bytes.  */
-        size_t offset;
+    /* Scan from there until a token starts past the edit right where one
+       started before it.  */
+    struct tstream_t fresh = { .alloc = stream->alloc };
+    size_t const     edit_end = offset + new_len;
+    size_t           old = keep;
+    bool             synced = false;
 
-        /* Wide byte representation of the current character
-           being parsed; used only to get the code point and
-           to save the correct lexeme.  */
-        char32_t c32;
+    lexer->cur          = lexer->buf + (start - lexer->base);
+    lexer->state        = LEX_STATE_CODE;
+    lexer->final        = true;
+    lexer->held_scanned = 0;
 
-        /* Extract the next multibyte character from the
-           string.  As the size of the input string is and
-           should remain unknown, SIZE_MAX indicates `mbrtoc32'
-           read as much as it can.  Offset should be set to be
-           the amount of bytes read; when its value is more than
-           one, we have consumed a multibyte character.  */
-        offset = mbrtoc32(&c32, (char const *) current(lexer), SIZE_MAX, &st1);
+    while (LEX_STATE_CODE == lexer->state)
+    {
+        size_t const          first  = fresh.size;
+        enum lex_status const status = lex_token(lexer, &fresh);
 
-        /* Invalid input.  */
-        if (offset == (size_t) -1)
-        {
-            error = true;
+        if (LEX_EOF == status)
             break;
+
+        if (first < fresh.size && fresh.tokens[first].pos >= edit_end)
+        {
+            size_t const was = fresh.tokens[first].pos - new_len + old_len;
+
+            while (old + 1 < n && tokens[old].pos < was)
+                ++old;
+
+            if (old + 1 < n && tokens[old].pos == was && TOK_CMD_ARG != tokens[old].type)
+            {
+                fresh.size = first;
+                synced     = true;
+                break;
+            }
         }
 
-        /* Truncated input.  */
-        if (offset == (size_t) -2)
+        if (LEX_ERROR == status)
+            lexer->state = LEX_STATE_HALTED;
+    }
+
+    if (fresh.failed)
+    {
+        tstream_free(&fresh);
+        stream->failed = true;
+        return -1;
+    }
+
+    /* Tokens from OLD on are kept, or else only the end of them all.  */
+    if (!synced)
+        old = n - 1;
+
+    size_t const size = keep + fresh.size + (n - old);
+
+    if (size > stream->capacity)
+    {
+        size_t cap = stream->capacity < 8 ? 8 : stream->capacity;
+        while (cap < size)
+            cap *= 2;
+
+        tokens = tstream_resize(stream, stream->capacity, cap);
+        if (!tokens)
         {
-            error = true;
-            break;
+            tstream_free(&fresh);
+            stream->failed = true;
+            return -1;
         }
 
-        // if (offset < 0)
-        // {
-        //     // catch EILSEQ
-        // }
+        stream->tokens   = tokens;
+        stream->capacity = cap;
+    }
+
+    size_t const tail = keep + fresh.size;
 
-#ifndef ch32_case
-#define ch32_case(c32, typ) \
-    case c32: \
-    { \
-        tstream_push(stream, (struct token_t) { .type = typ }); \
-        movn(lexer, (uint32_t)offset); \
-        continue; \
+    memmove(tokens + tail, tokens + old, (n - old) * sizeof(struct token_t));
+    if (fresh.size > 0)
+        memcpy(tokens + keep, fresh.tokens, fresh.size * sizeof(struct token_t));
+
+    stream->size = size;
+    tstream_free(&fresh);
+
+    for (size_t i = 0; i < keep; ++i)
+        rebase_text(lexer, &tokens[i]);
+
+    /* The tokens kept past the edit, or the end, moved along with it.  */
+    for (size_t i = tail; i < size; ++i)
+    {
+        tokens[i].pos = (uint32_t) (tokens[i].pos + new_len - old_len);
+        rebase_text(lexer, &tokens[i]);
     }
+
+    return 0;
+}
+
+size_t
+lex_validate(struct lexer_t *const lexer)
+{
+    char unsigned const *const bad = simd_utf8_validate(current(lexer), lexer->end);
+
+    if (bad < lexer->end)
+        return offset_of(lexer, bad);
+
+    lexer->trusted = true;
+    return (size_t) -1;
+}
+
+/* Smallest piece of the input source worth a thread of its own.  */
+#ifndef LEX_PARALLEL_MIN_CHUNK
+#  define LEX_PARALLEL_MIN_CHUNK  ( (size_t) 64 * 1024 )
 #endif
 
-        switch (c32)
+/* Most threads a single input source is ever split across.  */
+#define LEX_PARALLEL_MAX  64
+
+/* Farthest a chunk boundary is moved looking for white space.  */
+#define LEX_PARALLEL_MAX_SLIDE  ( (size_t) 4096 )
+
+/* A piece of the input source scanned on its own thread by
+   `lex_start_parallel'.  */
+struct lex_chunk
+{
+    /* Scans the piece, which ends at `lexer.end', as if there were more
+       input after it, unless it is the last one.  */
+    struct lexer_t   lexer;
+    struct tstream_t stream;
+    bool             last;
+
+    /* Where the first token of the piece would start; the start of the
+       piece until it is scanned, which it is not if its thread could not
+       be started.  */
+    char unsigned const *first;
+};
+
+static int
+lex_chunk_run(void *const arg)
+{
+    struct lex_chunk *const chunk = arg;
+
+    skip_blank(&chunk->lexer);
+    chunk->first = current(&chunk->lexer);
+
+    lex_run(&chunk->lexer, &chunk->stream, chunk->last);
+    return 0;
+}
+
+/* Append the tokens of SRC to the end of STREAM.  */
+static void
+tstream_append(struct tstream_t *const stream,
+                    struct tstream_t const *const src)
+{
+    if (stream->failed || 0 == src->size)
+        return;
+
+    if (stream->size + src->size > stream->capacity)
+    {
+        size_t cap = stream->capacity < 8 ? 8 : stream->capacity;
+        while (cap < stream->size + src->size)
+            cap *= 2;
+
+        struct token_t *const buffer = tstream_resize(stream, stream->capacity, cap);
+        if (!buffer)
         {
-            default: break;
-            ch32_case(0x000000F7, TOK_DIV_2)
-            ch32_case(0x0000230A, TOK_LFLOOR)
-            ch32_case(0x0000230B, TOK_RFLOOR)
-            ch32_case(0x00002308, TOK_LCEILING)
-            ch32_case(0x00002309, TOK_RCEILING)
-            ch32_case(0x00002229, TOK_SET_INTER)  /* Set operators coming below.  */
-            ch32_case(0x0000222A, TOK_SET_UNION)
-            ch32_case(0x00002286, TOK_SET_SUB)
-            ch32_case(0x00002284, TOK_SET_NSUB)
-            ch32_case(0x00002282, TOK_SET_PROPSUB)
-            ch32_case(0x00002287, TOK_SET_SUPER)
-            ch32_case(0x00002285, TOK_SET_NSUPER)
-            ch32_case(0x00002283, TOK_SET_PROPSUPER)
-            ch32_case(0x00002206, TOK_SET_SYMMDIFF)
-            ch32_case(0x00002208, TOK_SET_ELEMOF)
-            ch32_case(0x00002209, TOK_SET_NELEMOF)
-            ch32_case(0x000000D7, TOK_SET_CARTPROD)
-            ch32_case(0x000000D8, TOK_SET_EMPTY)
+            stream->failed = true;
+            return;
         }
 
-#undef ch32_case
+        stream->tokens   = buffer;
+        stream->capacity = cap;
+    }
 
-        /* Lex and identifier.  */
-        if (IS_IDENTIFIER(c32))
+    memcpy(stream->tokens + stream->size, src->tokens, src->size * sizeof(struct token_t));
+    stream->size += src->size;
+}
+
+int (*lex_thrd_create)(thrd_t *, thrd_start_t, void *) = thrd_create;
+
+int
+lex_start_parallel(struct lexer_t *const lexer,
+                        struct tstream_t *const stream,
+                        unsigned const nthreads)
+{
+    struct lex_chunk chunks[LEX_PARALLEL_MAX];
+    thrd_t           threads[LEX_PARALLEL_MAX];
+
+    size_t const len = (size_t) (lexer->end - current(lexer));
+    size_t       n   = len / LEX_PARALLEL_MIN_CHUNK;
+
+    if (n > nthreads)
+        n = nthreads;
+
+    if (n > LEX_PARALLEL_MAX)
+        n = LEX_PARALLEL_MAX;
+
+    if (n < 2 || too_large(lexer))
+        return lex_start(lexer, stream);
+
+    /* Cut the input source into N pieces of about the same size.  Pieces
+       are lexed speculatively, assuming each starts between two tokens,
+       which is most likely right at white space.  */
+    char unsigned const *from = current(lexer);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        char unsigned const *to = lexer->end;
+
+        if (i + 1 < n)
         {
-            (void)lex_identifier(lexer, stream);
-            continue;
+            to = current(lexer) + (i + 1) * (len / n);
+            if (to < from)
+                to = from;
+
+            char unsigned const *const limit = (size_t) (lexer->end - to) > LEX_PARALLEL_MAX_SLIDE
+                                                    ? to + LEX_PARALLEL_MAX_SLIDE : lexer->end;
+            char unsigned const *p = to;
+
+            while (p < limit && !IS_WHITESPACE(*p))
+                ++p;
+
+            if (p < limit)
+                to = p;
+
+            /* Never cut a character in two, which a trusted lexer would
+               decode past the end of its piece.  */
+            while (to > from && UTF8_IS_CONT(*to))
+                --to;
         }
 
-        /* Skip a comment block.  */
-        if (match(lexer, '{')
-            && match_at(lexer, 1, '{')
-            && match_at(lexer, 2, '*'))
+        struct lex_chunk *const chunk = &chunks[i];
+
+        /* Positions are taken relative to the start of the whole source.  */
+        chunk->lexer        = *lexer;
+        chunk->lexer.cur    = from;
+        chunk->lexer.end    = to;
+        chunk->lexer.symtab = nullptr;
+        chunk->lexer.diags  = nullptr;
+        chunk->lexer.state  = LEX_STATE_CODE;
+        chunk->stream       = (struct tstream_t) { 0 };
+        chunk->last         = i + 1 == n;
+        chunk->first        = from;
+
+        from = to;
+    }
+
+    /* The first piece is scanned on this thread.  A piece whose thread
+       could not be started is left for the stitching below.  */
+    bool started[LEX_PARALLEL_MAX] = { false };
+
+    /* Bind the scanning kernels now rather than racing to do it on first
+       use from every thread.  */
+    (void) simd_level();
+
+    for (size_t i = 1; i < n; ++i)
+        started[i] = thrd_success == lex_thrd_create(&threads[i], lex_chunk_run, &chunks[i]);
+
+    (void) lex_chunk_run(&chunks[0]);
+
+    for (size_t i = 1; i < n; ++i)
+    {
+        if (started[i])
+            (void) thrd_join(threads[i], nullptr);
+    }
+
+    /* Stitch the pieces together in order.  Scanning goes on from where a
+       piece stopped, with the whole source in view, up to the start of the
+       next piece.  If it lands exactly where the next piece found its
+       first token, the speculation was right and all its tokens are taken;
+       otherwise, e.g. a comment or a string spans across the pieces, they
+       are thrown away and scanning goes on to the next piece.  */
+    size_t const start = stream->size;
+    struct lexer_t seq = *lexer;
+
+    seq.symtab = nullptr;
+    seq.diags  = nullptr;
+    seq.state  = LEX_STATE_CODE;
+    seq.final  = true;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        struct lex_chunk *const chunk = &chunks[i];
+        if (LEX_STATE_COMMENT == seq.state)
+            skip_comment_body(&seq, stream);
+        else if (LEX_STATE_COMMAND == seq.state)
+            lex_cmd_args(&seq, stream);
+
+        while (LEX_STATE_CODE == seq.state)
         {
-            skip_comment(lexer);
-            continue;
+            skip_blank(&seq);
+
+            if (current(&seq) >= chunk->first)
+                break;
+
+            if (LEX_ERROR == lex_token(&seq, stream))
+                seq.state = LEX_STATE_HALTED;
         }
 
-        /* Lex a string.  */
-        if (match(lexer, '"'))
+        if (LEX_STATE_HALTED == seq.state)
+            break;
+
+        bool const taken = (0 == i || started[i])
+                                && LEX_STATE_CODE == seq.state
+                                && current(&seq) == chunk->first
+                                && !chunk->stream.failed;
+
+        if (taken)
         {
-            (void)lex_string(lexer, stream);
-            continue;
+            tstream_append(stream, &chunk->stream);
+            seq.cur        = current(&chunk->lexer);
+            seq.state      = chunk->lexer.state;
+            seq.comment_at = chunk->lexer.comment_at;
         }
+    }
+
+    for (size_t i = 0; i < n; ++i)
+        tstream_free(&chunks[i].stream);
 
-        /* Lex a number.  */
-        if (isdigit(peek(lexer)) || match(lexer, '.'))
+    /* Finish whatever the last piece could not.  */
+    lex_run(&seq, stream, true);
+
+    lexer->cur   = seq.cur;
+    lexer->state = seq.state;
+
+    /* Symbols are interned in order of appearance, as `lex_start' does.  */
+    if (lexer->symtab && !stream->failed)
+    {
+        for (size_t i = start; i < stream->size; ++i)
         {
-            if (match(lexer, '.') && match_at(lexer, 1, '.'))
-            {
-                if (match_at(lexer, 2, '.'))
-                {
-                    tstream_push(stream, (struct token_t) { .type = TOK_ELLIPSIS });
-                    movn(lexer, 3);
-                    continue;
-                }
+            struct token_t *const tok = &stream->tokens[i];
 
-                tstream_push(stream, (struct token_t) { .type = TOK_RANGE });
-                movn(lexer, 2);
-                continue;
-            }
+            if (TOK_NAME == tok->type || TOK_CONST == tok->type)
+                tok->sym = symtab_intern(lexer->symtab, tok->val.text.str, tok->val.text.len,
+                                         sym_hash(tok->val.text.str, tok->val.text.len));
+        }
+    }
 
-            (void)lex_number(lexer, stream);
-            continue;
+    record_diags(lexer, stream, start);
+    tstream_push(stream, (struct token_t) { .type = TOK_END,
+                                            .pos  = offset_of(lexer, lexer->end) });
+
+    return stream->failed ? -1 : 0;
+}
+
+/* Scan tokens into the lookahead queue of LEXER until it holds more than N
+   of them that have not been handed out.  Return false if the input source
+   runs out first.  */
+static bool
+lex_fill(struct lexer_t *const lexer, size_t const n)
+{
+    struct tstream_t *const queue = &lexer->queue;
+
+    if (queue->size - lexer->queue_head > n)
+        return true;
+
+    if (too_large(lexer))
+    {
+        queue->failed = true;
+        return false;
+    }
+
+    /* Drop the tokens already handed out.  */
+    if (lexer->queue_head > 0)
+    {
+        queue->size -= lexer->queue_head;
+        memmove(queue->tokens, queue->tokens + lexer->queue_head,
+                queue->size * sizeof(struct token_t));
+        lexer->queue_head = 0;
+    }
+
+    while (queue->size <= n)
+    {
+        if (LEX_STATE_CODE != lexer->state || queue->failed)
+            return false;
+
+        size_t const          first  = queue->size;
+        enum lex_status const status = lex_token(lexer, queue);
+
+        record_diags(lexer, queue, first);
+
+        if (LEX_EOF == status)
+            return false;
+
+        if (LEX_ERROR == status)
+            lexer->state = LEX_STATE_HALTED;
+    }
+
+    return true;
+}
+
+bool
+lex_next(struct lexer_t *const lexer,
+                struct token_t *const token)
+{
+    if (!lex_fill(lexer, 0))
+    {
+        *token = (struct token_t) { .type = TOK_END,
+                                    .pos  = offset_of(lexer, lexer->end) };
+        return false;
+    }
+
+    *token = lexer->queue.tokens[lexer->queue_head++];
+    return true;
+}
+
+bool
+lex_peek(struct lexer_t *const lexer,
+                size_t const n,
+                struct token_t *const token)
+{
+    if (!lex_fill(lexer, n))
+    {
+        *token = (struct token_t) { .type = TOK_END,
+                                    .pos  = offset_of(lexer, lexer->end) };
+        return false;
+    }
+
+    *token = lexer->queue.tokens[lexer->queue_head + n];
+    return true;
+}
+
+/* Append TOKEN to the end of the compact stream STREAM.  If there is no
+   memory left for it, STREAM is marked as failed and TOKEN, and all after
+   it, are dropped.  */
+static void
+ctstream_push(struct ctstream_t *const stream,
+                    struct token_t const token)
+{
+    if (stream->failed)
+        return;
+
+    /* The capacity is kept a multiple of the rank step.  */
+    if (1 + stream->size > stream->capacity)
+    {
+        size_t const cap = stream->capacity < CTSTREAM_RANK_STEP
+                                ? CTSTREAM_RANK_STEP : 2 * stream->capacity;
+
+        uint8_t *const  types = realloc(stream->types, cap * sizeof(uint8_t));
+        if (types)
+            stream->types = types;
+
+        uint32_t *const pos = realloc(stream->pos, cap * sizeof(uint32_t));
+        if (pos)
+            stream->pos = pos;
+
+        uint32_t *const ranks = realloc(stream->ranks, cap / CTSTREAM_RANK_STEP * sizeof(uint32_t));
+        if (ranks)
+            stream->ranks = ranks;
+
+        if (!types || !pos || !ranks)
+        {
+            stream->failed = true;
+            return;
         }
 
-        /* Set the default type of the next token to be scanned.  */
-        enum token_type type = TOK_UNK;
+        stream->capacity = cap;
+    }
+
+    if (CT_HAS_LEN(token.type) && 1 + stream->lens_size > stream->lens_capacity)
+    {
+        size_t const cap = stream->lens_capacity < 64 ? 64 : 2 * stream->lens_capacity;
+
+        uint32_t *const lens = realloc(stream->lens, cap * sizeof(uint32_t));
+        if (!lens)
+        {
+            stream->failed = true;
+            return;
+        }
 
-#ifndef ch8_case1
-#define ch8_case1(ch, typ) \
-    case ch: \
-    { \
-        type = typ; \
-        break; \
+        stream->lens          = lens;
+        stream->lens_capacity = cap;
     }
-#endif
 
-#ifndef ch8_case2
-#define ch8_case2(ch1, type1, ch2, type2) \
-    case ch1: \
-    { \
-        type = type1; \
-        if (!eof_at(lexer, 1) && match_at(lexer, 1, ch2)) \
-        { \
-            type = type2; \
-            mov(lexer); \
-        } \
-        break; \
+    if (0 == stream->size % CTSTREAM_RANK_STEP)
+        stream->ranks[stream->size / CTSTREAM_RANK_STEP] = (uint32_t) stream->lens_size;
+
+    stream->types[stream->size] = (uint8_t) token.type;
+    stream->pos[stream->size]   = token.pos;
+    ++stream->size;
+
+    if (TOK_UNK == token.type)
+        stream->lens[stream->lens_size++] = token.flags;
+    else if (TOK_HAS_TEXT(token.type))
+        stream->lens[stream->lens_size++] = (uint32_t) token.val.text.len;
+}
+
+int
+lex_start_compact(struct lexer_t *const lexer,
+                        struct ctstream_t *const stream)
+{
+    if (too_large(lexer))
+        return -1;
+
+    /* Tokens are pulled one at a time, so the only full stream ever built
+       is the compact one.  */
+    struct token_t tok;
+    while (lex_next(lexer, &tok))
+        ctstream_push(stream, tok);
+
+    ctstream_push(stream, tok);
+
+    bool const failed = stream->failed || lexer->queue.failed;
+
+    tstream_free(&lexer->queue);
+    lexer->queue_head = 0;
+    return failed ? -1 : 0;
+}
+
+struct token_t
+ctstream_get(struct ctstream_t const *const stream,
+                char unsigned const *const buf,
+                size_t const i)
+{
+    enum token_type const type = stream->types[i];
+    struct token_t        tok  = { .type = type, .pos = stream->pos[i] };
+
+    if (!CT_HAS_LEN(type))
+        return tok;
+
+    /* Count the lengths stored since the closest rank sample.  */
+    size_t rank = stream->ranks[i / CTSTREAM_RANK_STEP];
+    for (size_t j = i - i % CTSTREAM_RANK_STEP; j < i; ++j)
+        rank += CT_HAS_LEN(stream->types[j]) ? 1 : 0;
+
+    if (TOK_UNK == type)
+    {
+        tok.flags = (uint8_t) stream->lens[rank];
+        return tok;
     }
-#endif
 
-#ifndef ch8_case3
-#define ch8_case3(ch1, type1, ch2, type2, ch3, type3) \
-    case ch1: \
-    { \
-        type = type1; \
-        if (!eof_at(lexer, 1)) \
-        { \
-            if (match_at(lexer, 1, ch2)) \
-            { \
-                type  = type2; \
-                mov(lexer); \
-            } \
-            else if (match_at(lexer, 1, ch3)) \
-            { \
-                type  = type3; \
-                mov(lexer); \
-            } \
-        } \
-        break; \
+    /* The text of a string starts past the opening quote.  */
+    tok.val.text.str = buf + tok.pos + (TOK_STRING == type);
+    tok.val.text.len = stream->lens[rank];
+
+    /* Values are not kept, but numbers are quick to parse again, and
+       constants to look up.  */
+    if (TOK_NUMBER == type)
+        (void) scan_number(tok.val.text.str, tok.val.text.str + tok.val.text.len, &tok);
+    else if (TOK_CONST == type)
+        resolve_const(&tok, sym_hash(tok.val.text.str, tok.val.text.len));
+
+    return tok;
+}
+
+void
+ctstream_free(struct ctstream_t *const stream)
+{
+    free(stream->types);
+    free(stream->pos);
+    free(stream->lens);
+    free(stream->ranks);
+    *stream = (struct ctstream_t) { 0 };
+}
+
+/* Make room for at least SIZE bytes in the carry buffer of LEXER.  Return -1
+   if memory could not be allocated.  */
+[[nodiscard]]
+static int
+carry_reserve(struct lexer_t *const lexer, size_t const size)
+{
+    if (size <= lexer->carry_cap)
+        return 0;
+
+    size_t cap = lexer->carry_cap < 64 ? 64 : lexer->carry_cap;
+    while (cap < size)
+        cap *= 2;
+
+    char unsigned *const buffer = realloc(lexer->carry, cap);
+    if (!buffer)
+        return -1;
+
+    lexer->carry     = buffer;
+    lexer->carry_cap = cap;
+    return 0;
+}
+
+int
+lex_feed(struct lexer_t *const lexer,
+                char unsigned const *const chunk,
+                size_t const len,
+                struct tstream_t *const stream)
+{
+    if (lexer->base + lexer->carry_len + len > UINT32_MAX)
+        return -1;
+
+    /* Past input it could not get past, chunks only count towards the end
+       position.  */
+    if (LEX_STATE_HALTED == lexer->state)
+    {
+        lexer->base += len;
+        return 0;
+    }
+
+    if (0 == len)
+        return 0;
+
+    /* Held back bytes go first, so the chunk is appended to them; otherwise
+       the chunk is scanned in place.  Tokens scanned by the previous call
+       may point to the held back bytes, which is why they are only moved
+       to the start of the buffer now.  */
+    size_t const held = lexer->carry_len;
+
+    if (held > 0)
+    {
+        /* Bytes held back from a token that takes many chunks stay put.  */
+        if (lexer->carry_off > 0)
+            memmove(lexer->carry, lexer->carry + lexer->carry_off, held);
+
+        lexer->carry_off = 0;
+
+        if (0 != carry_reserve(lexer, held + len))
+            return -1;
+
+        memcpy(lexer->carry + held, chunk, len);
+        lex_setup_range(lexer, lexer->carry, held + len);
     }
-#endif
+    else
+        lex_setup_range(lexer, chunk, len);
+
+    size_t const         size  = stream->size;
+    enum lex_state const state = lexer->state;
+
+    lex_run(lexer, stream, false);
+
+    /* Hold back whatever could not be scanned.  */
+    size_t const rest = LEX_STATE_HALTED == lexer->state
+                            ? 0 : (size_t) (lexer->end - current(lexer));
+    size_t const used = (size_t) (lexer->end - lexer->buf) - rest;
 
-#ifndef ch8_case4
-#define ch8_case4(ch1, type1, ch2, type2, ch3, type3, ch4, type4) \
-    case ch1: \
-    { \
-        type = type1; \
-        if (!eof_at(lexer, 1)) \
-        { \
-            if (match_at(lexer, 1, ch2)) \
-            { \
-                type  = type2; \
-                mov(lexer); \
-            } \
-            else if (match_at(lexer, 1, ch3)) \
-            { \
-                type  = type3; \
-                mov(lexer); \
-            } \
-            else if (match_at(lexer, 1, ch4)) \
-            { \
-                type  = type4; \
-                mov(lexer); \
-            } \
-        } \
-        break; \
+    if (held > 0)
+    {
+        lexer->base     += used;
+        lexer->carry_off = used;
+        lexer->carry_len = rest;
+        return stream->failed ? -1 : 0;
     }
-#endif
 
-        switch (peek(lexer))
+    /* The chunk belongs to the caller, so the rest has to be copied.  */
+    if (0 != carry_reserve(lexer, rest))
+    {
+        stream->size = size;
+        lexer->state = state;
+        return -1;
+    }
+
+    if (rest > 0)
+        memcpy(lexer->carry, current(lexer), rest);
+
+    lexer->base     += used;
+    lexer->carry_off = 0;
+    lexer->carry_len = rest;
+    return stream->failed ? -1 : 0;
+}
+
+int
+lex_finish(struct lexer_t *const lexer,
+                struct tstream_t *const stream)
+{
+    uint32_t const end = (uint32_t) (lexer->base + lexer->carry_len);
+
+    /* A comment left open needs a last look, even with nothing left.  */
+    if ((lexer->carry_len > 0 || LEX_STATE_COMMENT == lexer->state)
+        && LEX_STATE_HALTED != lexer->state)
+    {
+        lex_setup_range(lexer, lexer->carry + lexer->carry_off, lexer->carry_len);
+        lex_run(lexer, stream, true);
+    }
+
+    lexer->base      = end;
+    lexer->carry_len = 0;
+    lexer->state     = LEX_STATE_CODE;
+    tstream_push(stream, (struct token_t) { .type = TOK_END, .pos = end });
+
+    return stream->failed ? -1 : 0;
+}
+
+struct position_t
+lex_position(struct lexer_t *const lexer,
+                size_t const offset)
+{
+    size_t const len = (size_t) (lexer->end - lexer->buf);
+
+    if (offset < lexer->base || offset - lexer->base > len || len > UINT32_MAX)
+        return (struct position_t) { 0 };
+
+    if (!lexer->indexed && len > 0)
+    {
+        /* Count the lines first, so the index takes a single allocation.  */
+        size_t const n = simd_index_lines(lexer->buf, lexer->end, nullptr);
+
+        if (n > 0)
         {
-            default  :  break;
-            case '$' :  lex_const(lexer, stream); continue;
-            case '\\':  lex_cmd(lexer, stream);   continue;
-            ch8_case1('(', TOK_LPAREN)
-            ch8_case1(')', TOK_RPAREN)
-            ch8_case1('[', TOK_LBRACKET)
-            ch8_case1(']', TOK_RBRACKET)
-            ch8_case1('{', TOK_LBRACE)
-            ch8_case1('}', TOK_RBRACE)
-
-            ch8_case1(',', TOK_COMMA)
-            ch8_case1(';', TOK_SEMICOLON)
-            ch8_case1('=', TOK_EQ)
-            ch8_case1('?', TOK_QMARK)
-            ch8_case1('%', TOK_MOD)
-            ch8_case1('#', TOK_HASH)
-            ch8_case1('@', TOK_ATSIGN)
-            ch8_case1('~', TOK_COMPL)
-            ch8_case1('^', TOK_XOR)
-            ch8_case1('/', TOK_DIV_1)
-            ch8_case2('&', TOK_AND,   '&', TOK_AND_AND)
-            ch8_case2('|', TOK_OR,    '|', TOK_OR_OR)
-            ch8_case2('+', TOK_PLUS,  '+', TOK_INC)
-            ch8_case2('-', TOK_MINUS, '-', TOK_DEC)
-            ch8_case2('*', TOK_MULT,  '*', TOK_EXP)
-            ch8_case2(':', TOK_COLON, '=', TOK_ASSIGN)
-            ch8_case2('!', TOK_NOT,   '=', TOK_NEQ_1)
-            ch8_case3('>', TOK_GT,    '=', TOK_GTE,   '>', TOK_RSHIFT)
-            ch8_case4('<', TOK_LT,    '>', TOK_NEQ_2, '=', TOK_LTE, '<', TOK_LSHIFT)
+            lexer->lines = malloc(n * sizeof(uint32_t));
+            if (!lexer->lines)
+                return (struct position_t) { 0 };
+
+            (void) simd_index_lines(lexer->buf, lexer->end, lexer->lines);
         }
 
-#undef ch8_case1
-#undef ch8_case2
-#undef ch8_case3
-#undef ch8_case4
+        lexer->nlines = n;
+    }
 
-        tstream_push(stream, (struct token_t) { .type = type });
-        mov(lexer);
+    lexer->indexed = true;
+
+    /* The line of the byte at AT is one past that of the last line feed
+       before it.  */
+    size_t const at = offset - lexer->base;
+    size_t       lo = 0;
+    size_t       hi = lexer->nlines;
+
+    while (lo < hi)
+    {
+        size_t const mid = lo + (hi - lo) / 2;
+
+        if (lexer->lines[mid] < at)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
 
-    tstream_push(stream, (struct token_t) { .type = TOK_END });
+    /* Characters are counted by their first byte, i.e., by any byte but a
+       continuation one.  */
+    size_t column = 1;
+
+    for (size_t i = lo > 0 ? lexer->lines[lo - 1] + 1 : 0; i < at; ++i)
+        column += 0x80 != (lexer->buf[i] & 0xC0);
+
+    return (struct position_t) { .line = (uint32_t) (1 + lo), .column = (uint32_t) column };
+}
+
+void
+lex_free(struct lexer_t *const lexer)
+{
+    free(lexer->lines);
+    free(lexer->carry);
+    tstream_free(&lexer->queue);
+    lex_setup_stream(lexer);
+}
+
+void
+lex_diags_free(struct lex_diags_t *const diags)
+{
+    free(diags->items);
+    *diags = (struct lex_diags_t) { 0 };
 }
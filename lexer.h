@@ -24,6 +24,10 @@
 #define TOK_LEXER_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <threads.h>
+
+#include "symtab.h"
 
 # ifndef TOK_TYPES_TABLE
 #  define TOK_TYPES_TABLE               \
@@ -106,6 +110,15 @@
     OP(RANGE,                   "..")   \
     OP(ELLIPSIS,               "...")   \
                                         \
+    /* Keywords.  */                    \
+                                        \
+    KW(FUNC,                  "func")   \
+    KW(RETURN,              "return")   \
+    KW(INT,                    "int")   \
+    KW(BOOL,                  "bool")   \
+    KW(TRUE,                  "true")   \
+    KW(FALSE,                "false")   \
+                                        \
     TOK(NAME,                  IDENT)   /* word */ \
     TOK(CONST,                 IDENT)   /* $2_SQRTPI */ \
     TOK(NUMBER,              LITERAL)   /* One of (dec|hex|oct|bin).  */ \
@@ -120,32 +133,132 @@
 enum token_type : short unsigned
 {
 #define OP( name, _ ) TOK_ ## name,
+#define KW( name, _ ) TOK_ ## name,
 #define TOK( name, _ ) TOK_ ## name,
     TOK_TYPES_TABLE
 #undef OP
+#undef KW
 #undef TOK
     MAX_TOKENS
 };
 
-struct identifier  /* FIXME: Convert into symbol table entry.  */
+/* Built-in constants, by name without the `$' and value.  */
+# ifndef LEX_CONSTS_TABLE
+#  define LEX_CONSTS_TABLE                              \
+    CONST(E,        2.7182818284590452354)   /* e          */ \
+    CONST(LOG2E,    1.4426950408889634074)   /* log_2 e    */ \
+    CONST(LOG10E,   0.43429448190325182765)  /* log_10 e   */ \
+    CONST(LN2,      0.69314718055994530942)  /* log_e 2    */ \
+    CONST(LN10,     2.30258509299404568402)  /* log_e 10   */ \
+    CONST(PI,       3.14159265358979323846)  /* pi         */ \
+    CONST(PI_2,     1.57079632679489661923)  /* pi/2       */ \
+    CONST(PI_4,     0.78539816339744830962)  /* pi/4       */ \
+    CONST(1_PI,     0.31830988618379067154)  /* 1/pi       */ \
+    CONST(2_PI,     0.63661977236758134308)  /* 2/pi       */ \
+    CONST(2_SQRTPI, 1.12837916709551257390)  /* 2/sqrt(pi) */ \
+    CONST(SQRT2,    1.41421356237309504880)  /* sqrt(2)    */ \
+    CONST(SQRT1_2,  0.70710678118654752440)  /* 1/sqrt(2)  */
+# endif
+
+/* Ids of the built-in constants.  */
+enum lex_const : uint8_t
+{
+    CONST_NONE,
+#define CONST( name, _ ) CONST_ ## name,
+    LEX_CONSTS_TABLE
+#undef CONST
+    MAX_CONSTS
+};
+
+/* Problems in the input source that the lexer gets past, by name and
+   message.  */
+# ifndef LEX_DIAGS_TABLE
+#  define LEX_DIAGS_TABLE                                                     \
+    DIAG(STRAY,   "stray character")                                         \
+    DIAG(UTF8,    "invalid UTF-8")                                           \
+    DIAG(CONST,   "`$' not followed by the name of a constant")              \
+    DIAG(CMD,     "`\\' not followed by the name of a meta-command")         \
+    DIAG(STRING,  "unterminated string")                                     \
+    DIAG(COMMENT, "unterminated comment")
+# endif
+
+/* Kinds of problems.  Each problem is scanned as a TOK_UNK token whose
+   `flags' tell its kind, after which scanning goes on right past it: past
+   the stray character, the ill-formed UTF-8 sequence, the `$' or the `\',
+   or the opening `"' of a string that is never closed.  An unterminated
+   comment takes the rest of the source, though, since the prose in it is
+   no code to go on with.  */
+enum lex_diag_kind : uint8_t
 {
-    char unsigned const *name;
-    size_t               len;
+    DIAG_NONE,
+#define DIAG( name, _ ) DIAG_ ## name,
+    LEX_DIAGS_TABLE
+#undef DIAG
+    MAX_DIAGS
+};
+
+/* A problem in the input source.  */
+struct lex_diag_t
+{
+    uint32_t           pos;   /* Offset of the TOK_UNK token.  */
+    enum lex_diag_kind kind;
+};
+
+/* Side table of the problems found by a lexer, in order (see `diags' in
+   `struct lexer_t').  A zero-initialized table is empty and ready to use.  */
+struct lex_diags_t
+{
+    struct lex_diag_t *items;
+    size_t             size;
+    size_t             capacity;
+
+    /* Set when memory for a problem could not be allocated; the problems
+       from there on are not recorded.  */
+    bool failed;
+};
+
+/* What the scanner found out about a number or a constant token, in its
+   `flags'.  A TOK_UNK token has an `enum lex_diag_kind' there instead.  */
+enum token_flags : uint8_t
+{
+    TOK_NUM_INT      = 1 << 0,  /* An integer; its value is in `ival'.  */
+    TOK_NUM_REAL     = 1 << 1,  /* A real number; its value is in `fval'.  */
+    TOK_NUM_OVERFLOW = 1 << 2,  /* Too large for `ival', which holds INT64_MAX,
+                                   or for `fval', which holds infinity.  */
+    TOK_CONST_UNKNOWN = 1 << 3, /* Not a built-in constant; `cid' is
+                                   `CONST_NONE'.  */
 };
 
 /* An individual lexical token scanned from source code.  */
 struct token_t
 {
     enum token_type type;
+    uint8_t         flags;  /* See `enum token_flags'.  */
+    enum lex_const  cid;    /* Which built-in constant a TOK_CONST is.  */
+    uint32_t        pos;    /* Offset of the first byte in the source.  */
     union
     {
-        struct identifier *node; /* An identifier in the symbol table.  */
         struct
         {
             char unsigned const *str;
             size_t               len;
-        } text; /* A string or a number.  */
+        } text; /* A name, a literal or a meta-command.  */
     } val;
+
+    union
+    {
+        /* Id of a name or a constant in the symbol table of the lexer, if
+           it has one, or `SYM_NONE'.  */
+        uint32_t sym;
+
+        /* Value of an integer number, parsed as it is scanned.  Octal
+           takes the `0o' prefix; `0755' is decimal.  */
+        int64_t  ival;
+
+        /* Value of a real number, i.e., one with a fraction or an exponent,
+           correctly rounded.  */
+        double   fval;
+    };
 };
 
 /* Container representing a sequential stream of scanned tokens.  */
@@ -159,6 +272,62 @@ struct tstream_t
 
     /* Underlying stream scanned tokens.  */
     struct token_t *tokens;
+
+    /* Where the memory of `tokens' comes from, or nullptr for the C
+       library allocator.  */
+    struct allocator_t const *alloc;
+
+    /* Set when memory for a token could not be allocated.  The stream is
+       incomplete then, and nothing else is appended until it is reset.  */
+    bool failed;
+};
+
+/* Token stream with the same contents as `struct tstream_t' in a compact
+   struct-of-arrays layout, meant for sources with millions of tokens: a
+   token takes 5 bytes, plus 4 when it has text (names, literals and
+   meta-commands; the spelling of an `OP' is fixed by its type) or is a
+   TOK_UNK, rather than 32.  Types can be scanned on their own, e.g. with
+   `memchr (stream.types, TOK_SEMICOLON, stream.size)'.  Use `ctstream_get'
+   to access a token by index.  */
+struct ctstream_t
+{
+    /* Amount of scanned tokens.  */
+    size_t size;
+
+    /* Next size when reallocating memory.  */
+    size_t capacity;
+
+    /* Type and source offset (see `struct token_t') of each token.  */
+    uint8_t  *types;
+    uint32_t *pos;
+
+    /* Text length of each token that has text, or kind of problem of each
+       TOK_UNK (see `enum lex_diag_kind'), in order.  */
+    uint32_t *lens;
+    size_t    lens_size;
+    size_t    lens_capacity;
+
+    /* Amount of lengths before each token whose index is a multiple of
+       `CTSTREAM_RANK_STEP', so finding the length of a token takes a
+       look at no more than that many types.  */
+    uint32_t *ranks;
+
+    /* Set when memory for a token could not be allocated.  */
+    bool failed;
+};
+
+#define CTSTREAM_RANK_STEP  64
+
+static_assert(MAX_TOKENS <= UINT8_MAX + 1, "token types must fit in a byte");
+
+/* What a lexer fed with `lex_feed' was in the middle of when the last chunk
+   ran out.  */
+enum lex_state : unsigned char
+{
+    LEX_STATE_CODE,     /* Between two tokens.  */
+    LEX_STATE_COMMENT,  /* Inside a `{{* *}}' comment.  */
+    LEX_STATE_COMMAND,  /* Among the arguments of a meta-command.  */
+    LEX_STATE_HALTED    /* Stopped at input it could not get past.  */
 };
 
 /* Lexical analyzer that transforms a raw source string into a sequential stream of
@@ -172,17 +341,249 @@ struct lexer_t
 
     /* Current read position in `buf'.  */
     char unsigned const *cur;
+
+    /* One past the last byte of `buf'.  */
+    char unsigned const *end;
+
+    /* Offset of `buf' in the whole input source, which is not zero only
+       when it is fed in chunks.  */
+    size_t base;
+
+    /* When set, names and constants are interned here as they are scanned,
+       so their tokens can be compared by symbol id.  Not owned by the
+       lexer; set it after setting up the lexer.  */
+    struct symtab_t *symtab;
+
+    /* When set, every problem in the input source that is scanned is
+       recorded here.  Not owned by the lexer; set it after setting up the
+       lexer.  */
+    struct lex_diags_t *diags;
+
+    /* Set when the input source is known to be well-formed UTF-8, so that
+       characters are decoded without checking anything; see
+       `lex_validate'.  Never set it for a source fed in chunks.  */
+    bool trusted;
+
+    /* Set when nothing follows `end', so a string or a comment that is not
+       closed by then never will be.  Cleared while scanning a chunk that
+       more input may follow.  */
+    bool final;
+
+    /* Offset of the last comment that was opened.  */
+    size_t comment_at;
+
+    /* Offset of the last string or argument of a meta-command whose end
+       was not found by the end of a chunk, and offset up to which it was
+       looked for, so that it is not looked for again from the start of the
+       token in the next chunk.  */
+    size_t held_at;
+    size_t held_scanned;
+
+    /* Trailing bytes of the chunks given to `lex_feed' that could not be
+       scanned yet, since the token they start may go on in the next chunk.
+       They are the CARRY_LEN bytes at offset CARRY_OFF of CARRY, which is
+       owned by the lexer.  */
+    char unsigned *carry;
+    size_t         carry_off;
+    size_t         carry_len;
+    size_t         carry_cap;
+
+    /* Where scanning resumes in the next chunk.  */
+    enum lex_state state;
+
+    /* Tokens scanned ahead by `lex_next' and `lex_peek' that have not been
+       handed out yet, starting at index QUEUE_HEAD.  */
+    struct tstream_t queue;
+    size_t           queue_head;
+
+    /* Offset in `buf' of each of the NLINES line feeds of the input
+       source, in order, once INDEXED is set by the first call to
+       `lex_position'.  Owned by the lexer.  */
+    uint32_t *lines;
+    size_t    nlines;
+    bool      indexed;
 };
 
-/* Configure LEXER to scan input source WHENCE. */
+/* Where a byte of the input source is, for humans: both numbers count
+   from one, and a column counts characters rather than bytes.  */
+struct position_t
+{
+    uint32_t line;
+    uint32_t column;
+};
+
+/* Configure LEXER to scan the NUL-terminated input source WHENCE. */
 void
 lex_setup(struct lexer_t *lexer,
                 char unsigned const *whence);
 
-/* Start scanning LEXER and append all generated tokens to the token
-   stream STREAM.  */
+/* Configure LEXER to scan the LEN bytes of input source at BUF.  BUF need not
+   be NUL-terminated, so any sub-range of a larger buffer can be scanned in
+   place, and NUL bytes within it are scanned like any other character.  */
 void
+lex_setup_n(struct lexer_t *lexer,
+                char unsigned const *buf,
+                size_t len);
+
+/* Configure LEXER to scan a source that arrives in chunks through
+   `lex_feed'.  */
+void
+lex_setup_stream(struct lexer_t *lexer);
+
+/* Return the value of the built-in constant ID, or NaN for `CONST_NONE'.  */
+double
+lex_const_value(enum lex_const id);
+
+/* Start scanning LEXER and append all generated tokens to the token
+   stream STREAM.  Return -1 if the input source is too large for the
+   32-bit offsets of tokens, in which case nothing is scanned, or if STREAM
+   ran out of memory (see the `failed' member of `struct tstream_t'), or
+   zero otherwise.  */
+int
 lex_start(struct lexer_t *lexer,
                 struct tstream_t *stream);
 
+/* Bring STREAM, which holds the tokens `lex_start' scanned from an input
+   source, up to date with an edit of that source that replaced the OLD_LEN
+   bytes at OFFSET with NEW_LEN others.  LEXER must be set up to scan the
+   whole source as edited.  Scanning starts again at the last token that the
+   edit cannot affect, and stops as soon as a token past the edit starts
+   where one started before it, since all tokens from there on are the same
+   but for their position; an edit that opens or closes a comment or a
+   string just takes more tokens to get there.  The text of every token
+   then points into the edited source.  Problems are not recorded in
+   `diags', whose offsets are those before the edit.  Return -1 if the
+   edited source is too large for 32-bit offsets, in which case STREAM is
+   left as it was, or if STREAM ran out of memory, in which case it must
+   be scanned anew, or zero otherwise.  */
+int
+lex_relex(struct lexer_t *lexer,
+                struct tstream_t *stream,
+                size_t offset,
+                size_t old_len,
+                size_t new_len);
+
+/* Check in one pass that the input source of LEXER is well-formed UTF-8.
+   If so, mark LEXER as trusted, which spares scanning all further checks,
+   and return -1.  Otherwise, return the offset of the first ill-formed
+   UTF-8 byte in the buffer.  */
+size_t
+lex_validate(struct lexer_t *lexer);
+
+/* Like `lex_start', but split the input source into up to NTHREADS pieces
+   of at least `LEX_PARALLEL_MIN_CHUNK' bytes and scan them at the same
+   time, each on its own thread.  The tokens appended to STREAM, including
+   their symbols, are exactly the ones `lex_start' would append; a piece
+   that turns out to start in the middle of a token, a comment or a string
+   is scanned again in order.  */
+int
+lex_start_parallel(struct lexer_t *lexer,
+                        struct tstream_t *stream,
+                        unsigned nthreads);
+
+/* Function `lex_start_parallel' starts its threads with, `thrd_create'
+   unless replaced.  A piece whose thread it fails to start is scanned on
+   the calling thread instead, which tests check by replacing it.  Only
+   replace it while no source is being scanned.  */
+extern int
+(*lex_thrd_create)(thrd_t *thread, thrd_start_t func, void *arg);
+
+/* Empty STREAM but keep its memory, so that scanning again into it does not
+   allocate anything until it needs more tokens than ever before.  */
+void
+tstream_reset(struct tstream_t *stream);
+
+/* Release the memory of STREAM, which is then empty again.  */
+void
+tstream_free(struct tstream_t *stream);
+
+/* Like `lex_start', but append the tokens to the compact stream STREAM.
+   Return -1 if the input source is too large for 32-bit offsets or memory
+   runs out, or zero otherwise.  */
+[[nodiscard]]
+int
+lex_start_compact(struct lexer_t *lexer,
+                struct ctstream_t *stream);
+
+/* Return the token at index I of STREAM, whose input source starts at BUF.  */
+struct token_t
+ctstream_get(struct ctstream_t const *stream,
+                char unsigned const *buf,
+                size_t i);
+
+/* Release the memory of STREAM.  */
+void
+ctstream_free(struct ctstream_t *stream);
+
+/* Scan the input source of LEXER only as far as needed to store its next
+   token in TOKEN and return true, or store TOK_END and return false once
+   the input source is exhausted, or is too large for 32-bit offsets, or
+   memory for the tokens scanned ahead runs out (see `queue.failed' for
+   the last two).  Tokens are scanned on demand, so a
+   consumer can work on the first statements of a source before the rest
+   has even been read.  Not to be mixed with `lex_start' on the same
+   LEXER, which must be released with `lex_free' afterwards.  */
+bool
+lex_next(struct lexer_t *lexer,
+                struct token_t *token);
+
+/* Like `lex_next', but store the token N positions ahead of the next one
+   in TOKEN without consuming anything.  `lex_peek (lexer, 0, &token)'
+   stores the token that `lex_next' is about to return.  */
+bool
+lex_peek(struct lexer_t *lexer,
+                size_t n,
+                struct token_t *token);
+
+/* Scan the next LEN bytes of a source set up with `lex_setup_stream' and
+   append the tokens that are complete to STREAM.  Chunks may split the
+   source anywhere, even inside a multibyte character, a token or a comment:
+   the bytes of a token that might still go on are kept by the lexer until
+   the next chunk, so memory stays proportional to the chunk size rather than
+   to the source size (a string, an argument of a meta-command or a name
+   is only ever held whole, though; the end of the first two is not looked
+   for again in the bytes already fed).  The text of the tokens appended is
+   valid until the next call to `lex_feed' or `lex_finish'.  Return -1 if
+   the chunk would take the source past the 32-bit offsets of tokens or
+   memory could not be allocated for the lexer, in which case the chunk is
+   not consumed, or if memory could not be allocated for STREAM, or zero
+   otherwise.  */
+[[nodiscard]]
+int
+lex_feed(struct lexer_t *lexer,
+                char unsigned const *chunk,
+                size_t len,
+                struct tstream_t *stream);
+
+/* Scan whatever `lex_feed' held back from LEXER and append the tokens and
+   TOK_END to STREAM.  Their text is valid until LEXER is fed again or
+   released.  Return -1 if STREAM ran out of memory, or zero otherwise.  */
+int
+lex_finish(struct lexer_t *lexer,
+                struct tstream_t *stream);
+
+/* Return the line and column of the byte at OFFSET in the input source of
+   LEXER, where OFFSET is the `pos' of a token, say.  Scanning does not
+   keep track of lines, which would slow down every byte; instead, the
+   first call indexes the line feeds of the whole source, and every call
+   looks OFFSET up in that index.  Return a zero line if OFFSET is past the
+   end of the source or memory for the index runs out.  Not for a source
+   fed in chunks.  */
+struct position_t
+lex_position(struct lexer_t *lexer,
+                size_t offset);
+
+/* Release the memory held by LEXER for `lex_feed', `lex_next' and
+   `lex_position'.  */
+void
+lex_free(struct lexer_t *lexer);
+
+/* Return the message of problems of KIND, e.g., "unterminated string".  */
+char const *
+lex_diag_message(enum lex_diag_kind kind);
+
+/* Release the memory of DIAGS.  */
+void
+lex_diags_free(struct lex_diags_t *diags);
+
 #endif //TOK_LEXER_H
@@ -0,0 +1,394 @@
+/*
+ * lexer_bench.c -- Lexer throughput benchmark.
+ *
+ * https://github.com/fontseca/lexemn
+ *
+ * Copyright (C) 2026 by Jeremy Fonseca <fontseca.dev@outlook.com>
+ *
+ * This file is part of Lexemn.
+ *
+ * Lexemn is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Lexemn is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Lexemn. If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+/* Measure how fast the lexer scans synthetic sources, each of which keeps
+   mostly one of its sub-lexers busy:
+
+       bench.out                        Print a table of the results.
+       bench.out --json                 Print the results as a baseline.
+       bench.out --check <baseline>     Fail if any result is significantly
+                                        worse than the one in <baseline>.
+
+   Absolute speeds depend on the machine, so each result is also given as a
+   score: its throughput relative to that of a fixed calibration loop run on
+   the same machine.  Only scores are compared against a baseline.  */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <x86intrin.h>
+#  define BENCH_HAVE_TSC 1
+#else
+#  define BENCH_HAVE_TSC 0
+#endif
+
+#include "lexer.h"
+
+/* Size of every generated source, and how many times each is lexed; only
+   the fastest run counts.  */
+#define BENCH_CORPUS_SIZE  ( (size_t) 4 << 20 )
+#define BENCH_RUNS         7
+
+/* A score lower than its baseline by more than this fraction fails the
+   check.  Generous, as runs on shared machines are noisy.  */
+#define BENCH_TOLERANCE    0.25
+
+/* Synthetic sources.  Each is made of its pieces, picked at random and
+   separated by white space.  */
+struct corpus
+{
+    char const        *name;
+    char const *const *pieces;
+};
+
+static char const *const ascii_pieces[] = {
+    "x", "y1", "count", "total_sum", "a_b_c", ":=", "+", "-", "*", "/", "=",
+    "(", ")", "[", "]", ";", ",", "<=", "!=", "&&", "42", "\"str\"", nullptr
+};
+
+static char const *const unicode_pieces[] = {
+    "größe", "水", "zß水🍌你好", "сумма", "Ø", "AØ", "ñandú", "λ", ":=", "+", nullptr
+};
+
+static char const *const comment_pieces[] = {
+    "{{* a short comment *}}",
+    "{{* a longer comment, which goes on and on about * stars and } braces *}}",
+    "{{*\n * documentation\n * spanning lines\n **}}",
+    "x", nullptr
+};
+
+static char const *const number_pieces[] = {
+    "0", "7", "42", "1024", "3.14", ".5", "1.", "65535", "0.000001",
+    "123456789", "+", nullptr
+};
+
+static char const *const setop_pieces[] = {
+    "∩", "∪", "⊆", "⊄", "⊂", "⊇", "⊅", "⊃", "∆", "∈", "∉", "×", "⌊", "⌋",
+    "⌈", "⌉", "A", "B", nullptr
+};
+
+static struct corpus const corpora[] = {
+    { "ascii",    ascii_pieces   },
+    { "unicode",  unicode_pieces },
+    { "comments", comment_pieces },
+    { "numbers",  number_pieces  },
+    { "setops",   setop_pieces   },
+};
+
+#define NCORPORA  ( sizeof(corpora) / sizeof(corpora[0]) )
+
+struct result
+{
+    double mbps;     /* Megabytes per second.  */
+    double tokps;    /* Millions of tokens per second.  */
+    double cpb;      /* Time stamp counter cycles per byte.  */
+    double score;    /* Throughput relative to the calibration loop.  */
+};
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+static uint64_t
+cycles(void)
+{
+#if BENCH_HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/* Fill BUF with LEN bytes of source made of PIECES.  */
+static void
+generate(char *const buf, size_t const len, char const *const *const pieces)
+{
+    static char const *const blanks[] = { " ", " ", " ", "\n", "  ", "\t" };
+
+    size_t   npieces = 0;
+    size_t   n       = 0;
+    uint32_t seed    = 1;
+
+    while (pieces[npieces])
+        ++npieces;
+
+    for (;;)
+    {
+        seed = seed * 1103515245 + 12345;
+
+        char const *const piece = pieces[(seed >> 8) % npieces];
+        char const *const blank = blanks[(seed >> 20) % (sizeof(blanks) / sizeof(blanks[0]))];
+        size_t const      plen  = strlen(piece);
+        size_t const      blen  = strlen(blank);
+
+        if (n + plen + blen > len)
+            break;
+
+        memcpy(buf + n, piece, plen);
+        memcpy(buf + n + plen, blank, blen);
+        n += plen + blen;
+    }
+
+    memset(buf + n, ' ', len - n);
+}
+
+/* Keeps the calibration loop from being optimized away.  */
+static uint32_t volatile sink;
+
+/* Return the throughput, in megabytes per second, of hashing BUF one byte
+   at a time.  Every step depends on the one before, so the compiler cannot
+   vectorize the loop, and its speed follows that of the CPU core much like
+   the speed of the lexer does.  Scores are relative to it.  */
+static double
+calibrate(char const *const buf, size_t const len)
+{
+    double best = 0;
+
+    for (int run = 0; run < BENCH_RUNS; ++run)
+    {
+        double const start = now();
+        uint32_t     hash  = 2166136261u;
+
+        for (size_t i = 0; i < len; ++i)
+            hash = (hash ^ (char unsigned) buf[i]) * 16777619u;
+
+        double const elapsed = now() - start;
+
+        sink = hash;
+
+        if (elapsed > 0 && (double) len / elapsed > best)
+            best = (double) len / elapsed;
+    }
+
+    return best / 1e6;
+}
+
+static struct result
+measure(char const *const buf, size_t const len, struct tstream_t *const stream)
+{
+    struct result result = { 0 };
+    double        best   = 0;
+    uint64_t      ticks  = 0;
+
+    for (int run = 0; run < BENCH_RUNS; ++run)
+    {
+        struct lexer_t lexer;
+
+        tstream_reset(stream);
+        lex_setup_n(&lexer, (char unsigned const *) buf, len);
+
+        double const   start = now();
+        uint64_t const tsc   = cycles();
+
+        if (0 != lex_start(&lexer, stream))
+        {
+            fprintf(stderr, "bench: out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+
+        uint64_t const tsc_elapsed = cycles() - tsc;
+        double const   elapsed     = now() - start;
+
+        if (0 == run || elapsed < best)
+        {
+            best  = elapsed;
+            ticks = tsc_elapsed;
+        }
+    }
+
+    if (best > 0)
+    {
+        result.mbps  = (double) len / best / 1e6;
+        result.tokps = (double) stream->size / best / 1e6;
+    }
+
+    result.cpb = (double) ticks / (double) len;
+    return result;
+}
+
+/* Return the score of the corpus called NAME in the baseline JSON, or a
+   negative value if it has none.  Only the output of `--json' needs to be
+   understood.  */
+static double
+baseline_score(char const *const json, char const *const name)
+{
+    char key[64];
+    snprintf(key, sizeof(key), "\"name\": \"%s\"", name);
+
+    char const *p = strstr(json, key);
+    if (!p)
+        return -1;
+
+    p = strstr(p, "\"score\":");
+    if (!p)
+        return -1;
+
+    return strtod(p + strlen("\"score\":"), nullptr);
+}
+
+static char *
+read_file(char const *const path)
+{
+    FILE *const fp = fopen(path, "rb");
+    if (!fp)
+    {
+        perror(path);
+        return nullptr;
+    }
+
+    char  *buf  = nullptr;
+    size_t size = 0;
+    size_t n    = 0;
+
+    for (;;)
+    {
+        if (n + 1 >= size)
+        {
+            size = size ? 2 * size : 4096;
+
+            char *const tmp = realloc(buf, size);
+            if (!tmp)
+            {
+                free(buf);
+                fclose(fp);
+                return nullptr;
+            }
+
+            buf = tmp;
+        }
+
+        size_t const got = fread(buf + n, 1, size - n - 1, fp);
+        if (0 == got)
+            break;
+
+        n += got;
+    }
+
+    buf[n] = '\0';
+    fclose(fp);
+    return buf;
+}
+
+int
+main(int const argc,
+            char const **argv)
+{
+    bool        json     = false;
+    char const *baseline = nullptr;
+
+    if (2 == argc && 0 == strcmp(argv[1], "--json"))
+        json = true;
+    else if (3 == argc && 0 == strcmp(argv[1], "--check"))
+        baseline = argv[2];
+    else if (1 != argc)
+    {
+        fprintf(stderr, "usage: %s [--json | --check <baseline.json>]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    char *const buf = malloc(BENCH_CORPUS_SIZE);
+    if (!buf)
+    {
+        fprintf(stderr, "bench: out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    struct tstream_t stream = { 0 };
+    struct result    results[NCORPORA];
+    double           calib  = 0;
+
+    for (size_t i = 0; i < NCORPORA; ++i)
+    {
+        generate(buf, BENCH_CORPUS_SIZE, corpora[i].pieces);
+
+        /* Calibrate on the first corpus only, so that scores of different
+           corpora can be compared with each other.  */
+        if (0 == i)
+            calib = calibrate(buf, BENCH_CORPUS_SIZE);
+
+        results[i]       = measure(buf, BENCH_CORPUS_SIZE, &stream);
+        results[i].score = calib > 0 ? results[i].mbps / calib : 0;
+    }
+
+    tstream_free(&stream);
+    free(buf);
+
+    if (json)
+    {
+        printf("{\n  \"calibration_mbps\": %.1f,\n  \"corpora\": [\n", calib);
+
+        for (size_t i = 0; i < NCORPORA; ++i)
+            printf("    { \"name\": \"%s\", \"mbps\": %.1f, \"mtokps\": %.2f, \"cpb\": %.2f, \"score\": %.4f }%s\n",
+                   corpora[i].name, results[i].mbps, results[i].tokps, results[i].cpb,
+                   results[i].score, i + 1 < NCORPORA ? "," : "");
+
+        printf("  ]\n}\n");
+        return EXIT_SUCCESS;
+    }
+
+    char *const base = baseline ? read_file(baseline) : nullptr;
+    if (baseline && !base)
+        return EXIT_FAILURE;
+
+    int status = EXIT_SUCCESS;
+
+    printf("%-10s %10s %10s %10s %8s%s\n", "corpus", "MB/s", "Mtok/s",
+           BENCH_HAVE_TSC ? "cycles/B" : "", "score", base ? "  baseline" : "");
+
+    for (size_t i = 0; i < NCORPORA; ++i)
+    {
+        printf("%-10s %10.1f %10.2f %10.2f %8.4f", corpora[i].name, results[i].mbps,
+               results[i].tokps, results[i].cpb, results[i].score);
+
+        if (base)
+        {
+            double const want = baseline_score(base, corpora[i].name);
+
+            if (want < 0)
+                printf("  (none)");
+            else
+            {
+                bool const regressed = results[i].score < want * (1 - BENCH_TOLERANCE);
+
+                printf("  %8.4f%s", want, regressed ? "  REGRESSED" : "");
+                if (regressed)
+                    status = EXIT_FAILURE;
+            }
+        }
+
+        putchar('\n');
+    }
+
+    printf("calibration: %.1f MB/s\n", calib);
+
+    free(base);
+    return status;
+}
@@ -0,0 +1,313 @@
+/*
+ * lexer_cache.c -- On-disk cache of token streams.
+ *
+ * https://github.com/fontseca/lexemn
+ *
+ * Copyright (C) 2026 by Jeremy Fonseca <fontseca.dev@outlook.com>
+ *
+ * This file is part of Lexemn.
+ *
+ * Lexemn is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Lexemn is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Lexemn. If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+/* A cache file holds a header followed by the arrays of a compact token
+   stream, with no pointers, so it can be mapped and used in place:
+
+       struct cache_header
+       uint32_t pos[size]
+       uint32_t lens[lens_size]
+       uint32_t ranks[ceil(size / CTSTREAM_RANK_STEP)]
+       uint8_t  types[size]
+
+   Numbers are in the byte order of the machine that wrote the file, which
+   the header tells, so a file from another machine is simply ignored.  */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "lexer_cache.h"
+
+#define CACHE_MAGIC  "LXMTOKS"
+
+/* Written as is, so the byte order of the machine shows.  */
+#define CACHE_ORDER  UINT32_C(0x01020304)
+
+/* Multipliers of the hash, the primes of xxHash64.  */
+#define HASH_P1  UINT64_C(0x9E3779B185EBCA87)
+#define HASH_P2  UINT64_C(0xC2B2AE3D27D4EB4F)
+#define HASH_P3  UINT64_C(0x165667B19E3779F9)
+
+struct cache_header
+{
+    char     magic[8];
+    uint32_t order;
+    uint32_t version;
+
+    /* Hash of the names of all token types, since a file is only good for
+       the same `enum token_type'.  */
+    uint64_t types_hash;
+
+    /* The source the tokens were scanned from.  */
+    uint64_t hash;
+    uint64_t len;
+
+    /* Amount of tokens and of text lengths.  */
+    uint64_t size;
+    uint64_t lens_size;
+};
+
+static_assert(0 == sizeof(struct cache_header) % sizeof(uint32_t),
+              "the arrays after the header must be aligned");
+
+/* Names of all token types, one after the other.  */
+static char const token_names[] =
+#define OP( name, raw ) #name " "
+#define KW( name, raw ) #name " "
+#define TOK( name, raw ) #name " "
+    TOK_TYPES_TABLE
+#undef TOK
+#undef KW
+#undef OP
+    ;
+
+static inline uint64_t
+rotl64(uint64_t const x, int const n)
+{
+    return (x << n) | (x >> (64 - n));
+}
+
+/* Read eight bytes at P in the byte order of the machine.  */
+static inline uint64_t
+load64(char unsigned const *const p)
+{
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+    return w;
+}
+
+uint64_t
+lex_cache_hash(char unsigned const *const buf,
+                size_t const len)
+{
+    char unsigned const *p   = buf;
+    char unsigned const *end = buf + len;
+    uint64_t             h   = HASH_P3 ^ (uint64_t) len;
+
+    /* Four independent lanes keep the multipliers busy.  */
+    if (len >= 32)
+    {
+        uint64_t lane[4] = { HASH_P1 + HASH_P2, HASH_P2, 0, -HASH_P1 };
+
+        for (; end - p >= 32; p += 32)
+        {
+            for (int i = 0; i < 4; ++i)
+                lane[i] = rotl64(lane[i] + load64(p + 8 * i) * HASH_P2, 31) * HASH_P1;
+        }
+
+        h = rotl64(lane[0], 1) + rotl64(lane[1], 7) + rotl64(lane[2], 12) + rotl64(lane[3], 18);
+        h ^= (uint64_t) len;
+    }
+
+    for (; end - p >= 8; p += 8)
+        h = rotl64(h ^ rotl64(load64(p) * HASH_P2, 31) * HASH_P1, 27) * HASH_P1 + HASH_P3;
+
+    for (; p < end; ++p)
+        h = rotl64(h ^ *p * HASH_P3, 11) * HASH_P1;
+
+    /* Let every bit of the input flip about half of those of the hash.  */
+    h ^= h >> 33;
+    h *= HASH_P2;
+    h ^= h >> 29;
+    h *= HASH_P3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+/* Return the amount of rank samples of a stream of SIZE tokens.  */
+static size_t
+ranks_size(size_t const size)
+{
+    return (size + CTSTREAM_RANK_STEP - 1) / CTSTREAM_RANK_STEP;
+}
+
+/* Return the size of a cache file of a stream of SIZE tokens and LENS_SIZE
+   text lengths.  */
+static size_t
+cache_file_size(size_t const size, size_t const lens_size)
+{
+    return sizeof(struct cache_header)
+                + (size + lens_size + ranks_size(size)) * sizeof(uint32_t)
+                + size * sizeof(uint8_t);
+}
+
+/* Write the LEN bytes at BUF to the file FD.  Return -1 on error, or zero
+   otherwise.  */
+static int
+write_all(int const fd, void const *const buf, size_t const len)
+{
+    char const *p = buf;
+    size_t      n = len;
+
+    while (n > 0)
+    {
+        ssize_t const put = write(fd, p, n);
+        if (put < 0)
+        {
+            if (EINTR == errno)
+                continue;
+
+            return -1;
+        }
+
+        p += put;
+        n -= (size_t) put;
+    }
+
+    return 0;
+}
+
+int
+lex_cache_store(char const *const path,
+                    struct ctstream_t const *const stream,
+                    uint64_t const hash,
+                    size_t const len)
+{
+    if (stream->failed)
+        return -1;
+
+    struct cache_header const header = {
+        .magic      = CACHE_MAGIC,
+        .order      = CACHE_ORDER,
+        .version    = LEX_CACHE_VERSION,
+        .types_hash = lex_cache_hash((char unsigned const *) token_names, sizeof(token_names) - 1),
+        .hash       = hash,
+        .len        = len,
+        .size       = stream->size,
+        .lens_size  = stream->lens_size,
+    };
+
+    size_t const tmp_len = strlen(path) + sizeof(".XXXXXX");
+    char *const  tmp     = malloc(tmp_len);
+    if (!tmp)
+        return -1;
+
+    snprintf(tmp, tmp_len, "%s.XXXXXX", path);
+
+    int const fd = mkstemp(tmp);
+    if (fd < 0)
+    {
+        free(tmp);
+        return -1;
+    }
+
+    int ret = 0 == write_all(fd, &header, sizeof(header))
+                && 0 == write_all(fd, stream->pos, stream->size * sizeof(uint32_t))
+                && 0 == write_all(fd, stream->lens, stream->lens_size * sizeof(uint32_t))
+                && 0 == write_all(fd, stream->ranks, ranks_size(stream->size) * sizeof(uint32_t))
+                && 0 == write_all(fd, stream->types, stream->size * sizeof(uint8_t))
+                    ? 0 : -1;
+
+    if (0 != close(fd) || 0 != ret || 0 != rename(tmp, path))
+    {
+        unlink(tmp);
+        ret = -1;
+    }
+
+    free(tmp);
+    return ret;
+}
+
+int
+lex_cache_load(char const *const path,
+                    uint64_t const hash,
+                    size_t const len,
+                    struct lex_cache_t *const cache)
+{
+    int const fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)
+            || (size_t) st.st_size < sizeof(struct cache_header))
+    {
+        close(fd);
+        return -1;
+    }
+
+    size_t const map_len = (size_t) st.st_size;
+    void *const  map     = mmap(nullptr, map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if (MAP_FAILED == map)
+        return -1;
+
+    struct cache_header header;
+    memcpy(&header, map, sizeof(header));
+
+    /* Counts are checked against the size of the file before anything is
+       made of them, so a file cut short or tampered with is ignored.  */
+    bool const good = 0 == memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic))
+                        && CACHE_ORDER == header.order
+                        && LEX_CACHE_VERSION == header.version
+                        && hash == header.hash
+                        && len == header.len
+                        && header.size > 0
+                        && header.size <= map_len
+                        && header.lens_size <= header.size
+                        && cache_file_size(header.size, header.lens_size) == map_len
+                        && lex_cache_hash((char unsigned const *) token_names, sizeof(token_names) - 1)
+                               == header.types_hash;
+
+    if (!good)
+    {
+        munmap(map, map_len);
+        return -1;
+    }
+
+    size_t const    size      = header.size;
+    size_t const    lens_size = header.lens_size;
+    uint32_t *const pos       = (uint32_t *) ((char *) map + sizeof(header));
+
+    cache->stream = (struct ctstream_t) {
+        .size          = size,
+        .capacity      = size,
+        .pos           = pos,
+        .lens          = pos + size,
+        .lens_size     = lens_size,
+        .lens_capacity = lens_size,
+        .ranks         = pos + size + lens_size,
+        .types         = (uint8_t *) (pos + size + lens_size + ranks_size(size)),
+    };
+
+    cache->map     = map;
+    cache->map_len = map_len;
+    return 0;
+}
+
+void
+lex_cache_free(struct lex_cache_t *const cache)
+{
+    if (cache->map)
+        munmap(cache->map, cache->map_len);
+
+    *cache = (struct lex_cache_t) { 0 };
+}
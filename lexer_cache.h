@@ -0,0 +1,83 @@
+/*
+ * lexer_cache.h -- On-disk cache of token streams.
+ *
+ * https://github.com/fontseca/lexemn
+ *
+ * Copyright (C) 2026 by Jeremy Fonseca <fontseca.dev@outlook.com>
+ *
+ * This file is part of Lexemn.
+ *
+ * Lexemn is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Lexemn is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Lexemn. If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#ifndef TOK_LEXER_CACHE_H
+#define TOK_LEXER_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lexer.h"
+
+/* Bumped whenever the layout of a cache file changes.  Files of any other
+   version are ignored.  */
+#define LEX_CACHE_VERSION  2
+
+/* Compact token stream (see `struct ctstream_t') read from a cache file.
+   Its arrays point straight into the file, which is mapped read-only, so
+   loading it costs no more than mapping the file and checking its header.  */
+struct lex_cache_t
+{
+    /* Tokens of the source, to be accessed with `ctstream_get', but never
+       appended to or freed with `ctstream_free'.  */
+    struct ctstream_t stream;
+
+    /* The mapped file.  */
+    void  *map;
+    size_t map_len;
+};
+
+/* Return a 64-bit hash of the LEN bytes at BUF, which keys the cache file
+   of a source.  Reads eight bytes at a time, so it runs at about the speed
+   of memory.  */
+uint64_t
+lex_cache_hash(char unsigned const *buf,
+                size_t len);
+
+/* Write STREAM, the tokens of a source of LEN bytes whose hash is HASH, to
+   a cache file at PATH.  The file is written under another name and renamed,
+   so readers never see half of it.  Return -1 if it could not be written,
+   or zero otherwise.  */
+[[nodiscard]]
+int
+lex_cache_store(char const *path,
+                    struct ctstream_t const *stream,
+                    uint64_t hash,
+                    size_t len);
+
+/* Map the cache file at PATH into CACHE.  Return -1 if there is no such
+   file, or it is not of this version, or not for the same token types, or
+   not for a source of LEN bytes whose hash is HASH, or zero otherwise.
+   Only the header is checked, not the tokens, which are trusted to be as
+   `lex_cache_store' wrote them.  */
+[[nodiscard]]
+int
+lex_cache_load(char const *path,
+                    uint64_t hash,
+                    size_t len,
+                    struct lex_cache_t *cache);
+
+/* Unmap the cache file loaded into CACHE.  */
+void
+lex_cache_free(struct lex_cache_t *cache);
+
+#endif //TOK_LEXER_CACHE_H
@@ -0,0 +1,333 @@
+/*
+ * lexer_float.c -- Decimal to binary floating-point conversion.
+ *
+ * https://github.com/fontseca/lexemn
+ *
+ * Copyright (C) 2026 by Jeremy Fonseca <fontseca.dev@outlook.com>
+ *
+ * This file is part of Lexemn.
+ *
+ * Lexemn is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Lexemn is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Lexemn. If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+/* Decimal numbers are converted as in Lemire, "Number Parsing at a Gigabyte
+   per Second" (2021).  Up to 19 significant digits are gathered into a
+   64-bit mantissa W, so that the number is W * 10^Q.  Then, in order:
+
+     - If both W and 10^Q are exact doubles, a single multiplication or
+       division rounds correctly (Clinger's fast path).
+
+     - Otherwise, W is multiplied by a 128-bit approximation of 5^Q, which
+       gives enough of the leading bits of the result to round correctly
+       (the Eisel-Lemire algorithm).
+
+     - If digits were left out of W, the result is only known to be right
+       if rounding W + 1 gives the same; when not, `strtod' has the final
+       word.  */
+
+#include <float.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lexer_float.h"
+#include "pow5_table.h"
+
+/* Significant decimal digits that always fit in a 64-bit mantissa.  */
+#define MANTISSA_DIGITS  19
+
+/* Significant digits handed to `strtod'.  No double needs more than 767
+   to be told apart from its neighbors; any digit beyond is only ever
+   needed to know whether it is zero.  */
+#define SLOW_DIGITS      800
+
+/* Exponents are saturated here, far beyond any that makes a difference.  */
+#define EXPONENT_LIMIT   100000
+
+/* Bits of a positive infinite double.  */
+#define DOUBLE_INF_BITS  UINT64_C(0x7FF0000000000000)
+
+/* Powers of ten that are exact doubles.  */
+static double const exact_pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define IS_DIGIT( c ) \
+    ( (unsigned) ( c ) - '0' < 10u )
+
+/* Return the low 64 bits of the product of A and B, and store the high 64
+   bits in *HI.  */
+static inline uint64_t
+mul128(uint64_t const a, uint64_t const b, uint64_t *const hi)
+{
+    uint64_t const a_lo = (uint32_t) a, a_hi = a >> 32;
+    uint64_t const b_lo = (uint32_t) b, b_hi = b >> 32;
+
+    uint64_t const p0 = a_lo * b_lo;
+    uint64_t const p1 = a_lo * b_hi;
+    uint64_t const p2 = a_hi * b_lo;
+    uint64_t const p3 = a_hi * b_hi;
+
+    uint64_t const mid = (p0 >> 32) + (uint32_t) p1 + (uint32_t) p2;
+
+    *hi = p3 + (p1 >> 32) + (p2 >> 32) + (mid >> 32);
+    return mid << 32 | (uint32_t) p0;
+}
+
+/* Return the bits of the double closest to W * 10^Q, where W is not zero,
+   rounding ties to even.  */
+static uint64_t
+eisel_lemire(uint64_t w, long const q)
+{
+    if (q < POW5_MIN)
+        return 0;
+
+    if (q > POW5_MAX)
+        return DOUBLE_INF_BITS;
+
+    int const lz = __builtin_clzll(w);
+    w <<= lz;
+
+    /* The leading bits of W * 5^Q.  Unless the bits below the 55 that are
+       needed are all ones, a carry from the lower half of 5^Q cannot reach
+       them, so it is not even computed.  */
+    uint64_t const *const pow5 = pow5_128[q - POW5_MIN];
+    uint64_t              hi;
+    uint64_t              lo = mul128(w, pow5[0], &hi);
+
+    if (0x1FF == (hi & 0x1FF))
+    {
+        uint64_t hi2;
+        (void) mul128(w, pow5[1], &hi2);
+
+        lo += hi2;
+        if (hi2 > lo)
+            ++hi;
+    }
+
+    /* Keep 54 bits, the 53 of the mantissa and one to round with.  The
+       binary exponent is that of 10^Q, i.e., floor(Q * log2(10)), adjusted
+       by the normalization of W and of the product.  */
+    int const upper = (int) (hi >> 63);
+    int const shift = upper + 64 - 52 - 3;
+    uint64_t  mantissa = hi >> shift;
+    int32_t   power2   = (int32_t) ((((152170 + 65536) * q) >> 16) + 63 + upper - lz + 1023);
+
+    /* Subnormal, or zero.  */
+    if (power2 <= 0)
+    {
+        if (-power2 + 1 >= 64)
+            return 0;
+
+        mantissa >>= -power2 + 1;
+        mantissa  += mantissa & 1;
+        mantissa >>= 1;
+
+        /* Rounding up may make it normal after all.  */
+        power2 = mantissa < UINT64_C(1) << 52 ? 0 : 1;
+        return (uint64_t) power2 << 52 | mantissa;
+    }
+
+    /* Exactly halfway between two doubles, which only happens when 5^Q is
+       exact, and then round to even: down, unlike the rest.  */
+    if (lo <= 1 && q >= -4 && q <= 23 && 1 == (mantissa & 3) && mantissa << shift == hi)
+        mantissa &= ~UINT64_C(1);
+
+    mantissa  += mantissa & 1;
+    mantissa >>= 1;
+
+    /* Rounding up carried into a new bit.  */
+    if (mantissa >= UINT64_C(2) << 52)
+    {
+        mantissa = UINT64_C(1) << 52;
+        ++power2;
+    }
+
+    if (power2 >= 0x7FF)
+        return DOUBLE_INF_BITS;
+
+    return (uint64_t) power2 << 52 | (mantissa & ~(UINT64_C(1) << 52));
+}
+
+/* Parse the exponent at P, which starts with `e' or `E', if P is before END.
+   Return where it ends, and add its value to *EXP10.  */
+static char unsigned const *
+parse_exponent(char unsigned const *p, char unsigned const *const end, long *const exp10)
+{
+    if (p >= end)
+        return p;
+
+    bool negative = false;
+    long value    = 0;
+
+    if (++p < end && ('+' == *p || '-' == *p))
+        negative = '-' == *p++;
+
+    for (; p < end; ++p)
+    {
+        if ('_' == *p)
+            continue;
+
+        if (!IS_DIGIT(*p))
+            break;
+
+        if (value < EXPONENT_LIMIT)
+            value = value * 10 + (*p - '0');
+    }
+
+    *exp10 += negative ? -value : value;
+    return p;
+}
+
+/* Convert the number in [P, END) with `strtod', which rounds correctly no
+   matter how many digits there are.  It is first written as its digits
+   and an exponent, without a decimal point, which is the only part of the
+   syntax of `strtod' that depends on the process locale.  */
+static double
+parse_real_slow(char unsigned const *p, char unsigned const *const end)
+{
+    char buf[SLOW_DIGITS + 32];
+    size_t n      = 0;
+    long   exp10  = 0;
+    bool   point  = false;
+    bool   sticky = false;
+
+    for (; p < end; ++p)
+    {
+        char unsigned const c = *p;
+
+        if ('_' == c)
+            continue;
+
+        if ('.' == c)
+        {
+            point = true;
+            continue;
+        }
+
+        if (!IS_DIGIT(c))
+            break;
+
+        if (0 == n && '0' == c)
+        {
+            exp10 -= point;
+            continue;
+        }
+
+        if (n < SLOW_DIGITS)
+        {
+            buf[n++] = (char) c;
+            exp10   -= point;
+        }
+        else
+        {
+            exp10  += !point;
+            sticky |= '0' != c;
+        }
+    }
+
+    /* Digits left out only matter in that they are not all zero.  */
+    if (sticky)
+    {
+        buf[n++] = '1';
+        --exp10;
+    }
+
+    (void) parse_exponent(p, end, &exp10);
+    snprintf(buf + n, sizeof(buf) - n, "e%ld", exp10);
+
+    return strtod(buf, nullptr);
+}
+
+double
+parse_real(char unsigned const *const start,
+                char unsigned const *const end,
+                bool *const overflow)
+{
+    char unsigned const *p         = start;
+    uint64_t             w         = 0;
+    int                  digits    = 0;
+    long                 exp10     = 0;
+    bool                 point     = false;
+    bool                 truncated = false;
+
+    for (; p < end; ++p)
+    {
+        char unsigned const c = *p;
+
+        if ('_' == c)
+            continue;
+
+        if ('.' == c)
+        {
+            point = true;
+            continue;
+        }
+
+        if (!IS_DIGIT(c))
+            break;
+
+        /* Leading zeros are not significant.  */
+        if (0 == digits && '0' == c)
+        {
+            exp10 -= point;
+            continue;
+        }
+
+        if (digits < MANTISSA_DIGITS)
+        {
+            w      = w * 10 + (uint64_t) (c - '0');
+            exp10 -= point;
+            ++digits;
+        }
+        else
+        {
+            exp10     += !point;
+            truncated |= '0' != c;
+        }
+    }
+
+    (void) parse_exponent(p, end, &exp10);
+    *overflow = false;
+
+    if (0 == w)
+        return 0.0;
+
+    if (exp10 > EXPONENT_LIMIT)
+        exp10 = EXPONENT_LIMIT;
+    else if (exp10 < -EXPONENT_LIMIT)
+        exp10 = -EXPONENT_LIMIT;
+
+#if FLT_EVAL_METHOD == 0
+    if (!truncated && w <= UINT64_C(1) << 53 && exp10 >= -22 && exp10 <= 22)
+        return exp10 < 0 ? (double) w / exact_pow10[-exp10] : (double) w * exact_pow10[exp10];
+#endif
+
+    uint64_t bits = eisel_lemire(w, exp10);
+
+    if (truncated && bits != eisel_lemire(w + 1, exp10))
+    {
+        double const value = parse_real_slow(start, end);
+
+        *overflow = value > DBL_MAX;
+        return value;
+    }
+
+    *overflow = DOUBLE_INF_BITS == bits;
+
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
@@ -0,0 +1,37 @@
+/*
+ * lexer_float.h -- Decimal to binary floating-point conversion.
+ *
+ * https://github.com/fontseca/lexemn
+ *
+ * Copyright (C) 2026 by Jeremy Fonseca <fontseca.dev@outlook.com>
+ *
+ * This file is part of Lexemn.
+ *
+ * Lexemn is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Lexemn is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Lexemn. If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#ifndef TOK_LEXER_FLOAT_H
+#define TOK_LEXER_FLOAT_H
+
+#include <stddef.h>
+
+/* Return the double closest to the decimal number in [P, END), rounding
+   ties to even.  The number is made of decimal digits, which may be grouped
+   by underscores, with at most one `.' among them, followed by an optional
+   exponent: `e' or `E', an optional sign, and more digits.  Set *OVERFLOW
+   if the number is too large for a double, in which case return infinity.
+   Unlike `strtod', this does not depend on the process locale.  */
+double
+parse_real(char unsigned const *p, char unsigned const *end, bool *overflow);
+
+#endif //TOK_LEXER_FLOAT_H
@@ -0,0 +1,686 @@
+/*
+ * lexer_gen.c -- Build-time generator of the lexer lookup tables.
+ *
+ * https://github.com/fontseca/lexemn
+ *
+ * Copyright (C) 2026 by Jeremy Fonseca <fontseca.dev@outlook.com>
+ *
+ * This file is part of Lexemn.
+ *
+ * Lexemn is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Lexemn is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Lexemn. If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+/* Tables in the lexer are derived from definitions that humans maintain
+   (ucn.def, lexer.h, ...) by this program, which runs as part of the build
+   and writes one C header per table:
+
+       lexer_gen.out <table> <output.h>  */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lexer.h"
+
+/* Character classes.  Must fit in a byte.  */
+enum
+{
+    UCN_IDENT = 1 << 0,  /* May start or continue an identifier.  */
+    UCN_DIGIT = 1 << 1,  /* May only continue an identifier.  */
+};
+
+/* Code points are classified in pages of 256 consecutive characters.  */
+#define UCN_MAX         0x110000
+#define UCN_PAGE_BITS   8
+#define UCN_PAGE_SIZE   ( 1 << UCN_PAGE_BITS )
+#define UCN_NPAGES      ( UCN_MAX / UCN_PAGE_SIZE )
+
+/* Write the two-stage classification table of ucn.def to FP.  The first
+   stage maps a page number to one of the distinct pages found, which the
+   second stage holds in full, so any code point C is classified as
+
+       ucn_pages[ucn_index[C >> 8]][C & 0xFF]
+
+   Only a handful of pages are distinct (most of them are either fully
+   inside or fully outside an identifier range), hence the table is small
+   enough to stay in cache.  */
+static int
+gen_ucn(FILE *const fp)
+{
+    static unsigned char classes[UCN_MAX];
+    static unsigned char index[UCN_NPAGES];
+    static unsigned char pages[UCN_NPAGES][UCN_PAGE_SIZE];
+    size_t npages = 0;
+
+#define UCN( class, lower, upper ) \
+    for (uint32_t c = ( lower ); c <= ( upper ); ++c) \
+        classes[c] |= UCN_ ## class;
+#include "ucn.def"
+#undef UCN
+
+    for (size_t page = 0; page < UCN_NPAGES; ++page)
+    {
+        unsigned char const *const src = classes + page * UCN_PAGE_SIZE;
+        size_t found = 0;
+
+        while (found < npages && 0 != memcmp(pages[found], src, UCN_PAGE_SIZE))
+            ++found;
+
+        if (found == npages)
+        {
+            if (npages > UINT8_MAX)
+            {
+                fprintf(stderr, "lexer_gen: too many distinct UCN pages\n");
+                return -1;
+            }
+
+            memcpy(pages[npages++], src, UCN_PAGE_SIZE);
+        }
+
+        index[page] = (unsigned char) found;
+    }
+
+    fprintf(fp, "/* Generated by lexer_gen.c from ucn.def.  Do not edit.  */\n\n");
+    fprintf(fp, "#define UCN_IDENT %d\n", UCN_IDENT);
+    fprintf(fp, "#define UCN_DIGIT %d\n\n", UCN_DIGIT);
+    fprintf(fp, "#define UCN_PAGE_BITS %d\n\n", UCN_PAGE_BITS);
+
+    fprintf(fp, "static unsigned char const ucn_index[%d] = {", UCN_NPAGES);
+    for (size_t page = 0; page < UCN_NPAGES; ++page)
+        fprintf(fp, "%s%u,", page % 32 ? " " : "\n    ", index[page]);
+    fprintf(fp, "\n};\n\n");
+
+    fprintf(fp, "static unsigned char const ucn_pages[%zu][%d] = {\n", npages, UCN_PAGE_SIZE);
+    for (size_t page = 0; page < npages; ++page)
+    {
+        fprintf(fp, "    {");
+        for (size_t c = 0; c < UCN_PAGE_SIZE; ++c)
+            fprintf(fp, "%s%u,", c % 32 ? " " : "\n        ", pages[page][c]);
+        fprintf(fp, "\n    },\n");
+    }
+    fprintf(fp, "};\n");
+
+    return 0;
+}
+
+/* Unsigned integers big enough for any power of five in the table below,
+   as base 2^32 digits from the least significant.  */
+#define BIG_LIMBS  80
+
+struct big
+{
+    uint32_t limb[BIG_LIMBS];
+};
+
+static void
+big_mul_small(struct big *const a, uint32_t const m)
+{
+    uint64_t carry = 0;
+
+    for (size_t i = 0; i < BIG_LIMBS; ++i)
+    {
+        uint64_t const t = (uint64_t) a->limb[i] * m + carry;
+        a->limb[i] = (uint32_t) t;
+        carry      = t >> 32;
+    }
+}
+
+static size_t
+big_bits(struct big const *const a)
+{
+    for (size_t i = BIG_LIMBS; i-- > 0;)
+    {
+        if (a->limb[i])
+            return 32 * i + 32 - (size_t) __builtin_clz(a->limb[i]);
+    }
+
+    return 0;
+}
+
+static unsigned
+big_bit(struct big const *const a, size_t const i)
+{
+    return a->limb[i / 32] >> (i % 32) & 1;
+}
+
+static void
+big_shl1(struct big *const a, unsigned const in)
+{
+    uint32_t carry = in;
+
+    for (size_t i = 0; i < BIG_LIMBS; ++i)
+    {
+        uint32_t const out = a->limb[i] >> 31;
+        a->limb[i] = a->limb[i] << 1 | carry;
+        carry      = out;
+    }
+}
+
+static int
+big_cmp(struct big const *const a, struct big const *const b)
+{
+    for (size_t i = BIG_LIMBS; i-- > 0;)
+    {
+        if (a->limb[i] != b->limb[i])
+            return a->limb[i] < b->limb[i] ? -1 : 1;
+    }
+
+    return 0;
+}
+
+static void
+big_sub(struct big *const a, struct big const *const b)
+{
+    uint64_t borrow = 0;
+
+    for (size_t i = 0; i < BIG_LIMBS; ++i)
+    {
+        uint64_t const t = (uint64_t) a->limb[i] - b->limb[i] - borrow;
+        a->limb[i] = (uint32_t) t;
+        borrow     = t >> 63;
+    }
+}
+
+/* Store in HI and LO the 128 bits of A starting at bit FROM, taking bits
+   below zero as zero.  */
+static void
+big_top128(struct big const *const a, long const from, uint64_t *const hi, uint64_t *const lo)
+{
+    *hi = *lo = 0;
+
+    for (long i = from + 127; i >= from; --i)
+    {
+        unsigned const bit = i >= 0 && big_bit(a, (size_t) i);
+
+        *hi = *hi << 1 | *lo >> 63;
+        *lo = *lo << 1 | bit;
+    }
+}
+
+/* Range of decimal exponents in the table.  Beyond it, any 19-digit
+   decimal mantissa rounds to zero or overflows a double.  */
+#define POW5_MIN  ( -342 )
+#define POW5_MAX  308
+
+/* Write the table of powers of five used by the Eisel-Lemire algorithm in
+   lexer_float.c to FP.  Each power 5^Q is normalized to 128 bits, the most
+   significant one set: those at or above zero are truncated, those below
+   zero are rounded up, so that the product of a mantissa with any of them
+   never falls short of the exact one.  */
+static int
+gen_pow5(FILE *const fp)
+{
+    fprintf(fp, "/* Generated by lexer_gen.c.  Do not edit.  */\n\n");
+    fprintf(fp, "#define POW5_MIN %d\n", POW5_MIN);
+    fprintf(fp, "#define POW5_MAX %d\n\n", POW5_MAX);
+    fprintf(fp, "static uint64_t const pow5_128[%d][2] = {\n", POW5_MAX - POW5_MIN + 1);
+
+    for (int q = POW5_MIN; q <= POW5_MAX; ++q)
+    {
+        struct big power = { { 1 } };
+        uint64_t   hi, lo;
+
+        for (int i = 0; i < (q < 0 ? -q : q); ++i)
+            big_mul_small(&power, 5);
+
+        size_t const z = big_bits(&power);
+
+        if (q >= 0)
+            big_top128(&power, (long) z - 128, &hi, &lo);
+        else
+        {
+            /* Divide 2^B by 5^-Q a bit at a time, then add one.  */
+            size_t const b = q >= -27 ? z + 127 : 2 * z + 128;
+            struct big   rem = { { 0 } }, quo = { { 0 } };
+
+            for (size_t i = b + 1; i-- > 0;)
+            {
+                big_shl1(&rem, i == b);
+                big_shl1(&quo, 0);
+
+                if (big_cmp(&rem, &power) >= 0)
+                {
+                    big_sub(&rem, &power);
+                    quo.limb[0] |= 1;
+                }
+            }
+
+            for (size_t i = 0; i < BIG_LIMBS && 0 == ++quo.limb[i]; ++i)
+                continue;
+
+            size_t const bits = big_bits(&quo);
+            big_top128(&quo, bits > 128 ? (long) bits - 128 : 0, &hi, &lo);
+        }
+
+        fprintf(fp, "    { 0x%016llXu, 0x%016llXu },  /* 5^%d */\n",
+                (unsigned long long) hi, (unsigned long long) lo, q);
+    }
+
+    fprintf(fp, "};\n");
+    return 0;
+}
+
+/* Largest table worth generating for a perfect hash, in bits of its
+   size.  */
+#define PH_MAX_BITS  10
+
+/* Find a perfect hash of the N distinct HASHES, i.e., a multiplier MULT for
+   which the top BITS bits of HASHES[i] * MULT are different for every I,
+   with BITS as small as possible.  Store 1 + I in SLOTS at the value of
+   those bits, and zero in the other entries.  Return false if there is
+   none.  */
+static bool
+perfect_hash(uint32_t const *const hashes, size_t const n,
+                uint32_t *const mult, unsigned *const bits,
+                size_t slots[static 1 << PH_MAX_BITS])
+{
+    *bits = 0;
+    while ((size_t) 1 << *bits < n)
+        ++*bits;
+
+    for (; *bits <= PH_MAX_BITS; ++*bits)
+    {
+        *mult = 1;
+
+        for (unsigned tries = 0; tries < 1u << 20; ++tries)
+        {
+            bool collision = false;
+
+            /* Odd multipliers from a linear congruential sequence.  */
+            *mult = (*mult * 1664525u + 1013904223u) | 1;
+
+            memset(slots, 0, sizeof(size_t) << PH_MAX_BITS);
+
+            for (size_t i = 0; i < n && !collision; ++i)
+            {
+                uint32_t const slot = (uint32_t) (hashes[i] * *mult) >> (32 - *bits);
+
+                collision   = 0 != slots[slot];
+                slots[slot] = 1 + i;
+            }
+
+            if (!collision)
+                return true;
+        }
+    }
+
+    return false;
+}
+
+/* Keywords of TOK_TYPES_TABLE, by token type and spelling.  */
+static char const *const keywords[][2] = {
+#define OP( name, _ )
+#define KW( name, spelling ) { "TOK_" #name, spelling },
+#define TOK( name, _ )
+    TOK_TYPES_TABLE
+#undef TOK
+#undef KW
+#undef OP
+};
+
+/* Constants of LEX_CONSTS_TABLE, by id and spelling.  */
+static char const *const constants[][2] = {
+#define CONST( name, _ ) { "CONST_" #name, "$" #name },
+    LEX_CONSTS_TABLE
+#undef CONST
+};
+
+/* Write a perfect hash table of the N words in WORDS, given by id and
+   spelling, to FP.  The table is called TABLE, its entries are of type
+   struct ENTRY, and its macros start with PREFIX.  It is keyed on the
+   symbol table hash of a word, which the lexer computes anyway as it scans
+   one, so a word is looked up as
+
+       TABLE[(uint32_t) (hash * PREFIX_HASH_MULT) >> PREFIX_HASH_SHIFT]
+
+   and is the word of that entry only if both hash and spelling match.  */
+static int
+gen_words(FILE *const fp, char const *const prefix,
+                char const *const table, char const *const entry,
+                char const *const id_type, size_t const n,
+                char const *const (*const words)[2])
+{
+    static size_t slots[1 << PH_MAX_BITS];
+    uint32_t      hashes[1 << PH_MAX_BITS];
+    size_t        maxlen = 0;
+    uint32_t      mult;
+    unsigned      bits;
+
+    if (n > sizeof(hashes) / sizeof(hashes[0]))
+    {
+        fprintf(stderr, "lexer_gen: too many %s\n", table);
+        return -1;
+    }
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        size_t const len = strlen(words[i][1]);
+
+        hashes[i] = sym_hash((char unsigned const *) words[i][1], len);
+        if (len > maxlen)
+            maxlen = len;
+    }
+
+    if (!perfect_hash(hashes, n, &mult, &bits, slots))
+    {
+        fprintf(stderr, "lexer_gen: no perfect hash of the %s found\n", table);
+        return -1;
+    }
+
+    fprintf(fp, "/* Generated by lexer_gen.c from lexer.h.  Do not edit.  */\n\n");
+    fprintf(fp, "#define %s_HASH_MULT  0x%08Xu\n", prefix, (unsigned) mult);
+    fprintf(fp, "#define %s_HASH_SHIFT %u\n\n", prefix, 32 - bits);
+    fprintf(fp, "#define %s_SLOT( hash ) \\\n"
+                "    ( (uint32_t) ( ( hash ) * %s_HASH_MULT ) >> %s_HASH_SHIFT )\n\n",
+            prefix, prefix, prefix);
+
+    fprintf(fp, "struct %s\n{\n", entry);
+    fprintf(fp, "    uint32_t hash;\n");
+    fprintf(fp, "    uint8_t  len;   /* Zero in empty entries.  */\n");
+    fprintf(fp, "    %s id;\n", id_type);
+    fprintf(fp, "    char     spelling[%zu];\n", maxlen + 1);
+    fprintf(fp, "};\n\n");
+
+    fprintf(fp, "static struct %s const %s[%u] = {\n", entry, table, 1u << bits);
+    for (uint32_t slot = 0; slot < 1u << bits; ++slot)
+    {
+        if (0 == slots[slot])
+            continue;
+
+        size_t const i = slots[slot] - 1;
+        fprintf(fp, "    [%u] = { 0x%08Xu, %zu, %s, \"%s\" },\n", (unsigned) slot,
+                (unsigned) hashes[i], strlen(words[i][1]), words[i][0], words[i][1]);
+    }
+    fprintf(fp, "};\n");
+
+    return 0;
+}
+
+static int
+gen_keywords(FILE *const fp)
+{
+    return gen_words(fp, "KW", "keywords", "keyword", "enum token_type",
+                     sizeof(keywords) / sizeof(keywords[0]), keywords);
+}
+
+static int
+gen_consts(FILE *const fp)
+{
+    return gen_words(fp, "CONST", "constants", "constant", "enum lex_const",
+                     sizeof(constants) / sizeof(constants[0]), constants);
+}
+
+/* Operators of TOK_TYPES_TABLE, by token type and spelling.  */
+static char const *const operators[][2] = {
+#define OP( name, spelling ) { "TOK_" #name, spelling },
+#define KW( name, _ )
+#define TOK( name, _ )
+    TOK_TYPES_TABLE
+#undef TOK
+#undef KW
+#undef OP
+};
+
+#define NOPERATORS  ( sizeof(operators) / sizeof(operators[0]) )
+
+/* Most states of the operator automaton: one per byte of every spelling,
+   plus the dead and the start states.  */
+#define OP_MAX_STATES  256
+
+/* Write the automaton that recognizes the operators of lexer.h, on raw
+   bytes, to FP.  It is the trie of their spellings: every state stands for
+   a prefix of some of them, the dead state 0 for none and the start state
+   1 for the empty one.  Bytes with the same transitions out of every state
+   are merged into one class, so that the transition table has a column per
+   class rather than per byte, and the lexer steps from state S on byte B
+   to
+
+       op_next[S][op_class[B]]
+
+   which is the dead state for any byte that is in no operator at all.
+   Operators that are a prefix of another, such as `<' of `<=', are found
+   by remembering the last accepting state on the way.  */
+static int
+gen_operators(FILE *const fp)
+{
+    static unsigned next[OP_MAX_STATES][256];
+    static char const *accept[OP_MAX_STATES];
+    unsigned nstates = 2;
+
+    for (size_t i = 0; i < NOPERATORS; ++i)
+    {
+        unsigned state = 1;
+
+        for (char const *c = operators[i][1]; *c; ++c)
+        {
+            unsigned *const to = &next[state][(unsigned char) *c];
+
+            if (0 == *to)
+            {
+                if (OP_MAX_STATES == nstates)
+                {
+                    fprintf(stderr, "lexer_gen: too many operator states\n");
+                    return -1;
+                }
+
+                *to = nstates++;
+            }
+
+            state = *to;
+        }
+
+        if (accept[state])
+        {
+            fprintf(stderr, "lexer_gen: operator `%s' defined twice\n", operators[i][1]);
+            return -1;
+        }
+
+        accept[state] = operators[i][0];
+    }
+
+    /* Class of each byte, where class 0 is that of bytes in no operator.  */
+    unsigned char class[256] = { 0 };
+    int           first[256];   /* A byte of each class.  */
+    unsigned      nclasses = 1;
+
+    first[0] = -1;
+
+    for (int b = 0; b < 256; ++b)
+    {
+        bool used = false;
+
+        for (unsigned s = 0; s < nstates && !used; ++s)
+            used = 0 != next[s][b];
+
+        if (!used)
+            continue;
+
+        unsigned c = 1;
+
+        for (; c < nclasses; ++c)
+        {
+            unsigned s = 0;
+
+            while (s < nstates && next[s][b] == next[s][first[c]])
+                ++s;
+
+            if (s == nstates)
+                break;
+        }
+
+        if (c == nclasses)
+            first[nclasses++] = b;
+
+        class[b] = (unsigned char) c;
+    }
+
+    fprintf(fp, "/* Generated by lexer_gen.c from lexer.h.  Do not edit.  */\n\n");
+    fprintf(fp, "#define OP_DEAD    0\n");
+    fprintf(fp, "#define OP_START   1\n");
+    fprintf(fp, "#define OP_STATES  %u\n", nstates);
+    fprintf(fp, "#define OP_CLASSES %u\n\n", nclasses);
+
+    fprintf(fp, "static uint8_t const op_class[256] = {");
+    for (int b = 0; b < 256; ++b)
+        fprintf(fp, "%s%u,", b % 16 ? " " : "\n    ", class[b]);
+    fprintf(fp, "\n};\n\n");
+
+    fprintf(fp, "static uint8_t const op_next[OP_STATES][OP_CLASSES] = {\n");
+    for (unsigned s = 0; s < nstates; ++s)
+    {
+        fprintf(fp, "    {");
+        for (unsigned c = 0; c < nclasses; ++c)
+            fprintf(fp, "%s%u", c ? ", " : " ", c ? next[s][first[c]] : 0);
+        fprintf(fp, " },\n");
+    }
+    fprintf(fp, "};\n\n");
+
+    fprintf(fp, "/* Operator recognized in each state, or MAX_TOKENS.  */\n");
+    fprintf(fp, "static uint8_t const op_accept[OP_STATES] = {\n");
+    for (unsigned s = 0; s < nstates; ++s)
+        fprintf(fp, "    %s,\n", accept[s] ? accept[s] : "MAX_TOKENS");
+    fprintf(fp, "};\n");
+
+    return 0;
+}
+
+/* Kinds of tokens told apart by their first byte.  */
+#define SCAN_CLASSES_TABLE                                                      \
+    SCAN(OTHER)       /* A stray byte.  */                                      \
+    SCAN(NAME)        /* An ASCII identifier or keyword.  */                    \
+    SCAN(NUMBER)      /* A digit.  */                                           \
+    SCAN(DOT)         /* A number such as `.5' or an operator such as `..'.  */ \
+    SCAN(BRACE)       /* A comment or an operator.  */                          \
+    SCAN(OPERATOR)    /* Any other ASCII operator.  */                          \
+    SCAN(STRING)                                                                \
+    SCAN(CONST)                                                                 \
+    SCAN(CMD)                                                                   \
+    SCAN(MULTIBYTE)   /* Anything that starts with a multibyte character.  */
+
+enum
+{
+#define SCAN( name ) SCAN_ ## name,
+    SCAN_CLASSES_TABLE
+#undef SCAN
+    NSCAN_CLASSES
+};
+
+static char const *const scan_names[] = {
+#define SCAN( name ) #name,
+    SCAN_CLASSES_TABLE
+#undef SCAN
+};
+
+/* Write the class of each byte that may start a token to FP, so that the
+   lexer can jump straight to the right sub-lexer.  Names follow ucn.def,
+   and operators the OP() entries of lexer.h.  */
+static int
+gen_scan(FILE *const fp)
+{
+    static unsigned char ucn[0x80];
+    unsigned char        class[256] = { SCAN_OTHER };
+
+#define UCN( class, lower, upper ) \
+    for (uint32_t c = ( lower ); c <= ( upper ) && c < 0x80; ++c) \
+        ucn[c] |= UCN_ ## class;
+#include "ucn.def"
+#undef UCN
+
+    for (size_t i = 0; i < NOPERATORS; ++i)
+        class[(unsigned char) operators[i][1][0]] = SCAN_OPERATOR;
+
+    for (int b = 0; b < 256; ++b)
+    {
+        if (b >= 0x80)
+            class[b] = SCAN_MULTIBYTE;
+        else if ('"' == b)
+            class[b] = SCAN_STRING;
+        else if ('$' == b)
+            class[b] = SCAN_CONST;
+        else if ('\\' == b)
+            class[b] = SCAN_CMD;
+        else if ('{' == b)
+            class[b] = SCAN_BRACE;
+        else if ('.' == b)
+            class[b] = SCAN_DOT;
+        else if (b >= '0' && b <= '9')
+            class[b] = SCAN_NUMBER;
+        else if (ucn[b] & UCN_IDENT)
+            class[b] = SCAN_NAME;
+    }
+
+    fprintf(fp, "/* Generated by lexer_gen.c from ucn.def and lexer.h.  Do not edit.  */\n\n");
+    fprintf(fp, "enum scan_class\n{\n");
+    for (size_t c = 0; c < NSCAN_CLASSES; ++c)
+        fprintf(fp, "    SCAN_%s,\n", scan_names[c]);
+    fprintf(fp, "    SCAN_CLASSES\n};\n\n");
+
+    fprintf(fp, "static uint8_t const scan_classes[256] = {");
+    for (int b = 0; b < 256; ++b)
+        fprintf(fp, "%s%u,", b % 16 ? " " : "\n    ", class[b]);
+    fprintf(fp, "\n};\n");
+
+    return 0;
+}
+
+struct table
+{
+    char const *name;
+    int       (*gen)(FILE *);
+};
+
+static struct table const tables[] = {
+    { "ucn",       gen_ucn       },
+    { "pow5",      gen_pow5      },
+    { "keywords",  gen_keywords  },
+    { "consts",    gen_consts    },
+    { "operators", gen_operators },
+    { "scan",      gen_scan      },
+};
+
+int
+main(int const argc,
+            char const **argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: %s <table> <output.h>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < sizeof(tables) / sizeof(tables[0]); ++i)
+    {
+        if (0 != strcmp(argv[1], tables[i].name))
+            continue;
+
+        FILE *const fp = fopen(argv[2], "w");
+        if (!fp)
+        {
+            perror(argv[2]);
+            return EXIT_FAILURE;
+        }
+
+        int const ret = tables[i].gen(fp);
+        if (0 != fclose(fp) || 0 != ret)
+        {
+            remove(argv[2]);
+            return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    fprintf(stderr, "lexer_gen: unknown table `%s'\n", argv[1]);
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,632 @@
+/*
+ * lexer_simd.c -- Vectorized scanning kernels used by the lexer.
+ *
+ * https://github.com/fontseca/lexemn
+ *
+ * Copyright (C) 2026 by Jeremy Fonseca <fontseca.dev@outlook.com>
+ *
+ * This file is part of Lexemn.
+ *
+ * Lexemn is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Lexemn is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Lexemn. If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#include <stdint.h>
+#include <string.h>
+#include <threads.h>
+
+#include "lexer_simd.h"
+#include "utf8.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#  define SIMD_X86 1
+#  include <immintrin.h>
+#else
+#  define SIMD_X86 0
+#endif
+
+/* The vector kernels always load whole aligned blocks.  An aligned block
+   never straddles a page boundary, so reading the bytes that surround
+   [P, END) inside the first and the last block cannot fault, but it does
+   look like an overflow to the address sanitizer.  Matches found outside
+   of the range are discarded.  */
+#if defined(__GNUC__) || defined(__clang__)
+#  define SIMD_OVERREAD [[gnu::no_sanitize_address]]
+#else
+#  define SIMD_OVERREAD
+#endif
+
+/* Return non-zero value if C is a white space byte.  Must agree with
+   `IS_WHITESPACE' in lexer.c.  */
+#define IS_BLANK( c ) \
+    ( ( c ) == ' ' || ( ( c ) >= '\t' && ( c ) <= '\r' ) )
+
+static char unsigned const *
+skip_blank_scalar(char unsigned const *p, char unsigned const *const end)
+{
+    while (p < end && IS_BLANK(*p))
+        ++p;
+
+    return p;
+}
+
+static char unsigned const *
+find_star_scalar(char unsigned const *p, char unsigned const *const end)
+{
+    while (p < end && *p != '*')
+        ++p;
+
+    return p;
+}
+
+static size_t
+index_lines_scalar(char unsigned const *const p, char unsigned const *const end,
+                        uint32_t *const offsets)
+{
+    size_t n = 0;
+
+    for (char unsigned const *q = p; q < end; ++q)
+    {
+        if ('\n' != *q)
+            continue;
+
+        if (offsets)
+            offsets[n] = (uint32_t) (q - p);
+
+        ++n;
+    }
+
+    return n;
+}
+
+static char unsigned const *
+utf8_validate_scalar(char unsigned const *p, char unsigned const *const end)
+{
+    char32_t c32;
+
+    while (p < end)
+    {
+        /* Skip ASCII eight bytes at a time.  */
+        uint64_t word;
+        if (end - p >= 8 && (memcpy(&word, p, 8), 0 == (word & UINT64_C(0x8080808080808080))))
+        {
+            p += 8;
+            continue;
+        }
+
+        if (*p < 0x80)
+        {
+            ++p;
+            continue;
+        }
+
+        size_t const len = utf8_decode_multi(&c32, p, end);
+        if (UTF8_INVALID == len || UTF8_TRUNCATED == len)
+            return p;
+
+        p += len;
+    }
+
+    return p;
+}
+
+#if SIMD_X86 && defined(__SSE2__)
+
+/* Return a mask with one bit set for each white space byte in V.  Bytes
+   `\t' through `\r' are contiguous, and since the comparison is signed,
+   bytes >= 0x80 never fall into that range.  */
+static inline unsigned
+blank_mask_sse2(__m128i const v)
+{
+    __m128i const space = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+    __m128i const ctrl  = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('\t' - 1)),
+                                        _mm_cmplt_epi8(v, _mm_set1_epi8('\r' + 1)));
+
+    return (unsigned) _mm_movemask_epi8(_mm_or_si128(space, ctrl));
+}
+
+SIMD_OVERREAD
+static char unsigned const *
+skip_blank_sse2(char unsigned const *p, char unsigned const *const end)
+{
+    unsigned const       skew = (unsigned) ((uintptr_t) p & 15);
+    char unsigned const *blk  = p - skew;
+
+    /* Bytes before P in the first block count as blank.  */
+    unsigned mask = blank_mask_sse2(_mm_load_si128((__m128i const *) blk))
+                        | ((1u << skew) - 1);
+
+    while (0xFFFF == mask)
+    {
+        blk += 16;
+        if (blk >= end)
+            return end;
+
+        mask = blank_mask_sse2(_mm_load_si128((__m128i const *) blk));
+    }
+
+    p = blk + __builtin_ctz(~mask);
+    return p < end ? p : end;
+}
+
+SIMD_OVERREAD
+static char unsigned const *
+find_star_sse2(char unsigned const *p, char unsigned const *const end)
+{
+    unsigned const       skew = (unsigned) ((uintptr_t) p & 15);
+    char unsigned const *blk  = p - skew;
+    __m128i const        star = _mm_set1_epi8('*');
+
+    /* Bytes before P in the first block never match.  */
+    unsigned mask = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((__m128i const *) blk), star))
+                        & ~((1u << skew) - 1);
+
+    while (0 == mask)
+    {
+        blk += 16;
+        if (blk >= end)
+            return end;
+
+        mask = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((__m128i const *) blk), star));
+    }
+
+    p = blk + __builtin_ctz(mask);
+    return p < end ? p : end;
+}
+
+SIMD_OVERREAD
+static size_t
+index_lines_sse2(char unsigned const *const p, char unsigned const *const end,
+                        uint32_t *const offsets)
+{
+    unsigned const       skew = (unsigned) ((uintptr_t) p & 15);
+    char unsigned const *blk  = p - skew;
+    __m128i const        nl   = _mm_set1_epi8('\n');
+    size_t               n    = 0;
+
+    /* Bytes before P in the first block never match.  */
+    unsigned mask = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((__m128i const *) blk), nl))
+                        & ~((1u << skew) - 1);
+
+    for (;;)
+    {
+        /* Nor do those past END in the last one.  */
+        if (end - blk < 16)
+            mask &= (1u << (end - blk)) - 1;
+
+        if (!offsets)
+            n += (size_t) __builtin_popcount(mask);
+        else
+        {
+            for (; mask; mask &= mask - 1)
+                offsets[n++] = (uint32_t) (blk + __builtin_ctz(mask) - p);
+        }
+
+        blk += 16;
+        if (blk >= end)
+            return n;
+
+        mask = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((__m128i const *) blk), nl));
+    }
+}
+
+/* Only ASCII is skipped in vectors; SSE2 has no byte shuffle to classify
+   multibyte sequences with, so those are checked one at a time.  */
+static char unsigned const *
+utf8_validate_sse2(char unsigned const *p, char unsigned const *const end)
+{
+    char32_t c32;
+
+    while (end - p >= 16)
+    {
+        unsigned const mask = (unsigned) _mm_movemask_epi8(_mm_loadu_si128((__m128i const *) p));
+
+        if (0 == mask)
+        {
+            p += 16;
+            continue;
+        }
+
+        p += __builtin_ctz(mask);
+
+        do
+        {
+            size_t const len = utf8_decode_multi(&c32, p, end);
+            if (UTF8_INVALID == len || UTF8_TRUNCATED == len)
+                return p;
+
+            p += len;
+        }
+        while (p < end && *p >= 0x80);
+    }
+
+    return utf8_validate_scalar(p, end);
+}
+
+#endif
+
+#if SIMD_X86
+
+[[gnu::target("avx2")]]
+static inline uint32_t
+blank_mask_avx2(__m256i const v)
+{
+    __m256i const space = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+    __m256i const ctrl  = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('\t' - 1)),
+                                           _mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), v));
+
+    return (uint32_t) _mm256_movemask_epi8(_mm256_or_si256(space, ctrl));
+}
+
+SIMD_OVERREAD
+[[gnu::target("avx2")]]
+static char unsigned const *
+skip_blank_avx2(char unsigned const *p, char unsigned const *const end)
+{
+    unsigned const       skew = (unsigned) ((uintptr_t) p & 31);
+    char unsigned const *blk  = p - skew;
+
+    uint32_t mask = blank_mask_avx2(_mm256_load_si256((__m256i const *) blk))
+                        | (uint32_t) ((UINT64_C(1) << skew) - 1);
+
+    while (UINT32_MAX == mask)
+    {
+        blk += 32;
+        if (blk >= end)
+            return end;
+
+        mask = blank_mask_avx2(_mm256_load_si256((__m256i const *) blk));
+    }
+
+    p = blk + __builtin_ctz(~mask);
+    return p < end ? p : end;
+}
+
+SIMD_OVERREAD
+[[gnu::target("avx2")]]
+static char unsigned const *
+find_star_avx2(char unsigned const *p, char unsigned const *const end)
+{
+    unsigned const       skew = (unsigned) ((uintptr_t) p & 31);
+    char unsigned const *blk  = p - skew;
+    __m256i const        star = _mm256_set1_epi8('*');
+
+    uint32_t mask = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256((__m256i const *) blk), star))
+                        & ~(uint32_t) ((UINT64_C(1) << skew) - 1);
+
+    while (0 == mask)
+    {
+        blk += 32;
+        if (blk >= end)
+            return end;
+
+        mask = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256((__m256i const *) blk), star));
+    }
+
+    p = blk + __builtin_ctz(mask);
+    return p < end ? p : end;
+}
+
+SIMD_OVERREAD
+[[gnu::target("avx2")]]
+static size_t
+index_lines_avx2(char unsigned const *const p, char unsigned const *const end,
+                        uint32_t *const offsets)
+{
+    unsigned const       skew = (unsigned) ((uintptr_t) p & 31);
+    char unsigned const *blk  = p - skew;
+    __m256i const        nl   = _mm256_set1_epi8('\n');
+    size_t               n    = 0;
+
+    uint32_t mask = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256((__m256i const *) blk), nl))
+                        & ~(uint32_t) ((UINT64_C(1) << skew) - 1);
+
+    for (;;)
+    {
+        if (end - blk < 32)
+            mask &= (uint32_t) ((UINT64_C(1) << (end - blk)) - 1);
+
+        if (!offsets)
+            n += (size_t) __builtin_popcount(mask);
+        else
+        {
+            for (; mask; mask &= mask - 1)
+                offsets[n++] = (uint32_t) (blk + __builtin_ctz(mask) - p);
+        }
+
+        blk += 32;
+        if (blk >= end)
+            return n;
+
+        mask = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256((__m256i const *) blk), nl));
+    }
+}
+
+/* UTF-8 is validated 32 bytes at a time following Keiser and Lemire,
+   "Validating UTF-8 In Less Than One Instruction Per Byte" (2021).  Each
+   byte is checked together with the three before it: the high nibble of
+   the byte before and of the byte itself, and the low nibble of the byte
+   before, are looked up in the tables below, each giving the set of errors
+   that nibble allows.  Only those errors that all three allow are present.
+   What no pair of bytes can tell, whether the third and the fourth byte of
+   a sequence are continuation bytes, is checked apart.  */
+enum
+{
+    UTF8_TOO_SHORT  = 1 << 0,   /* Lead byte not followed by continuation.  */
+    UTF8_TOO_LONG   = 1 << 1,   /* Continuation byte after ASCII.  */
+    UTF8_OVERLONG_3 = 1 << 2,   /* E0 followed by 80..9F.  */
+    UTF8_TOO_LARGE  = 1 << 3,   /* Above U+10FFFF.  */
+    UTF8_SURROGATE  = 1 << 4,   /* ED followed by A0..BF.  */
+    UTF8_OVERLONG_2 = 1 << 5,   /* C0 or C1.  */
+    UTF8_OVERLONG_4 = 1 << 6,   /* F0 followed by 80..8F, or F5 and up.  */
+    UTF8_TWO_CONTS  = 1 << 7,   /* Two continuation bytes in a row.  */
+
+    UTF8_CARRY      = UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS,
+};
+
+/* `_mm256_shuffle_epi8' looks up each 128-bit lane on its own.  */
+#define UTF8_LANES( ... )  { __VA_ARGS__, __VA_ARGS__ }
+
+/* Indexed by the high nibble of the byte before.  */
+static char unsigned const utf8_prev_high[32] = UTF8_LANES(
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+    UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+    UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+    UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_OVERLONG_4);
+
+/* Indexed by the low nibble of the byte before.  */
+static char unsigned const utf8_prev_low[32] = UTF8_LANES(
+    UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_OVERLONG_2,
+    UTF8_CARRY,
+    UTF8_CARRY,
+    UTF8_CARRY | UTF8_TOO_LARGE,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_OVERLONG_4 | UTF8_SURROGATE,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_OVERLONG_4);
+
+/* Indexed by the high nibble of the byte itself.  */
+static char unsigned const utf8_cur_high[32] = UTF8_LANES(
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_OVERLONG_4,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT);
+
+/* A block ends in the middle of a sequence if any of its last three bytes
+   is above the matching limit here.  */
+static char unsigned const utf8_incomplete[32] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1
+};
+
+/* Bytes of V shifted in by N from the end of PREV.  */
+#define UTF8_PREV( v, prev, n ) \
+    _mm256_alignr_epi8(( v ), _mm256_permute2x128_si256(( prev ), ( v ), 0x21), 16 - ( n ))
+
+[[gnu::target("avx2")]]
+static inline __m256i
+utf8_lookup_avx2(char unsigned const *const table, __m256i const index)
+{
+    return _mm256_shuffle_epi8(_mm256_loadu_si256((__m256i const *) table), index);
+}
+
+/* Return a vector that is not zero if the bytes of V, following those of
+   PREV, contain any error.  */
+[[gnu::target("avx2")]]
+static inline __m256i
+utf8_errors_avx2(__m256i const v, __m256i const prev)
+{
+    __m256i const nibble = _mm256_set1_epi8(0x0F);
+    __m256i const prev1  = UTF8_PREV(v, prev, 1);
+
+    __m256i const special =
+        _mm256_and_si256(_mm256_and_si256(utf8_lookup_avx2(utf8_prev_high, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+                                          utf8_lookup_avx2(utf8_prev_low, _mm256_and_si256(prev1, nibble))),
+                         utf8_lookup_avx2(utf8_cur_high, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble)));
+
+    /* Bytes two after a lead byte of three or more, or three after one of
+       four, must be continuation bytes; only those get bit 7 set here.  */
+    __m256i const third  = _mm256_subs_epu8(UTF8_PREV(v, prev, 2), _mm256_set1_epi8(0xE0 - 0x80));
+    __m256i const fourth = _mm256_subs_epu8(UTF8_PREV(v, prev, 3), _mm256_set1_epi8((char) (0xF0 - 0x80)));
+    __m256i const must   = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8((char) 0x80));
+
+    /* Where a continuation byte must be, TWO_CONTS is found instead.  */
+    return _mm256_xor_si256(must, special);
+}
+
+[[gnu::target("avx2")]]
+static char unsigned const *
+utf8_validate_avx2(char unsigned const *const p, char unsigned const *const end)
+{
+    __m256i const limits     = _mm256_loadu_si256((__m256i const *) utf8_incomplete);
+    __m256i       prev       = _mm256_setzero_si256();
+    __m256i       incomplete = _mm256_setzero_si256();
+    char unsigned const *blk = p;
+
+    while (end - blk >= 32)
+    {
+        __m256i const v = _mm256_loadu_si256((__m256i const *) blk);
+        __m256i       error;
+
+        if (0 == _mm256_movemask_epi8(v))
+        {
+            error      = incomplete;
+            incomplete = _mm256_setzero_si256();
+        }
+        else
+        {
+            error      = utf8_errors_avx2(v, prev);
+            incomplete = _mm256_subs_epu8(v, limits);
+        }
+
+        if (!_mm256_testz_si256(error, error))
+            break;
+
+        prev = v;
+        blk += 32;
+    }
+
+    /* Find the exact byte at fault, if any, and check the bytes left over
+       one by one, starting with the sequence cut by BLK, if any.  */
+    char unsigned const *from = blk;
+
+    for (size_t k = 1; k <= 3 && (size_t) (blk - p) >= k; ++k)
+    {
+        char unsigned const b = blk[-(ptrdiff_t) k];
+
+        if (b < 0x80)
+            break;
+
+        if (b >= 0xC0)
+        {
+            if (0 == UTF8_SEQ_LEN(b) || UTF8_SEQ_LEN(b) > k)
+                from = blk - k;
+
+            break;
+        }
+    }
+
+    return utf8_validate_scalar(from, end);
+}
+
+#endif
+
+/* Kernels start bound to these stubs, which bind the best implementation
+   for the running CPU on first use and call it.  Binding happens once,
+   whichever thread gets there first, and the pointers are atomic, so that
+   threads scanning at the same time never see a pointer half written.  */
+static char unsigned const *
+skip_blank_resolve(char unsigned const *p, char unsigned const *end);
+
+static char unsigned const *
+find_star_resolve(char unsigned const *p, char unsigned const *end);
+
+static char unsigned const *
+utf8_validate_resolve(char unsigned const *p, char unsigned const *end);
+
+static size_t
+index_lines_resolve(char unsigned const *p, char unsigned const *end, uint32_t *offsets);
+
+char unsigned const *(*_Atomic simd_skip_blank)(char unsigned const *,
+                                                char unsigned const *) = skip_blank_resolve;
+char unsigned const *(*_Atomic simd_find_star)(char unsigned const *,
+                                               char unsigned const *)  = find_star_resolve;
+char unsigned const *(*_Atomic simd_utf8_validate)(char unsigned const *,
+                                                   char unsigned const *) = utf8_validate_resolve;
+size_t (*_Atomic simd_index_lines)(char unsigned const *, char unsigned const *,
+                                   uint32_t *) = index_lines_resolve;
+
+static _Atomic enum simd_level current_level = SIMD_SCALAR;
+static once_flag               bound         = ONCE_FLAG_INIT;
+
+/* Bind the kernels to the best instruction set not above LEVEL that the
+   running CPU supports and return it.  */
+static enum simd_level
+bind(enum simd_level const level)
+{
+#if SIMD_X86
+    __builtin_cpu_init();
+
+    if (level >= SIMD_AVX2 && __builtin_cpu_supports("avx2"))
+    {
+        simd_skip_blank    = skip_blank_avx2;
+        simd_find_star     = find_star_avx2;
+        simd_utf8_validate = utf8_validate_avx2;
+        simd_index_lines   = index_lines_avx2;
+        return current_level = SIMD_AVX2;
+    }
+#endif
+
+#if SIMD_X86 && defined(__SSE2__)
+    if (level >= SIMD_SSE2)
+    {
+        simd_skip_blank    = skip_blank_sse2;
+        simd_find_star     = find_star_sse2;
+        simd_utf8_validate = utf8_validate_sse2;
+        simd_index_lines   = index_lines_sse2;
+        return current_level = SIMD_SSE2;
+    }
+#endif
+
+    (void) level;
+    simd_skip_blank    = skip_blank_scalar;
+    simd_find_star     = find_star_scalar;
+    simd_utf8_validate = utf8_validate_scalar;
+    simd_index_lines   = index_lines_scalar;
+    return current_level = SIMD_SCALAR;
+}
+
+static void
+bind_best(void)
+{
+    (void) bind(SIMD_AVX2);
+}
+
+enum simd_level
+simd_use(enum simd_level const level)
+{
+    /* Binding on first use must not undo this later.  */
+    call_once(&bound, bind_best);
+    return bind(level);
+}
+
+enum simd_level
+simd_level(void)
+{
+    call_once(&bound, bind_best);
+    return current_level;
+}
+
+static char unsigned const *
+skip_blank_resolve(char unsigned const *const p, char unsigned const *const end)
+{
+    call_once(&bound, bind_best);
+    return simd_skip_blank(p, end);
+}
+
+static char unsigned const *
+find_star_resolve(char unsigned const *const p, char unsigned const *const end)
+{
+    call_once(&bound, bind_best);
+    return simd_find_star(p, end);
+}
+
+static char unsigned const *
+utf8_validate_resolve(char unsigned const *const p, char unsigned const *const end)
+{
+    call_once(&bound, bind_best);
+    return simd_utf8_validate(p, end);
+}
+
+static size_t
+index_lines_resolve(char unsigned const *const p, char unsigned const *const end,
+                        uint32_t *const offsets)
+{
+    call_once(&bound, bind_best);
+    return simd_index_lines(p, end, offsets);
+}
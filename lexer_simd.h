@@ -0,0 +1,73 @@
+/*
+ * lexer_simd.h -- Vectorized scanning kernels used by the lexer.
+ *
+ * https://github.com/fontseca/lexemn
+ *
+ * Copyright (C) 2026 by Jeremy Fonseca <fontseca.dev@outlook.com>
+ *
+ * This file is part of Lexemn.
+ *
+ * Lexemn is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Lexemn is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Lexemn. If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#ifndef TOK_LEXER_SIMD_H
+#define TOK_LEXER_SIMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Instruction set used by the scanning kernels.  Levels are ordered, so a
+   higher level is always preferred when the CPU supports it.  */
+enum simd_level : unsigned char
+{
+    SIMD_SCALAR,
+    SIMD_SSE2,
+    SIMD_AVX2
+};
+
+/* Return the first byte in [P, END) that is not white space, or END if
+   there is none.  P must be before END.  */
+extern char unsigned const *
+(*_Atomic simd_skip_blank)(char unsigned const *p, char unsigned const *end);
+
+/* Return the first `*' in [P, END), or END if there is none.  Used to jump
+   straight to the next candidate for the comment closing sequence `*}}'.
+   P must be before END.  */
+extern char unsigned const *
+(*_Atomic simd_find_star)(char unsigned const *p, char unsigned const *end);
+
+/* Return the first byte in [P, END) that does not belong to a well-formed
+   UTF-8 sequence, taking a sequence cut short by END as ill-formed, or END
+   if there is none.  The rules are those of `utf8_decode'.  */
+extern char unsigned const *
+(*_Atomic simd_utf8_validate)(char unsigned const *p, char unsigned const *end);
+
+/* Store the offset from P of every line feed in [P, END) in OFFSETS,
+   unless it is a null pointer, and return how many there are.  OFFSETS
+   must have room for all of them, and END - P must fit in 32 bits.  P must
+   be before END.  */
+extern size_t
+(*_Atomic simd_index_lines)(char unsigned const *p, char unsigned const *end, uint32_t *offsets);
+
+/* Return the instruction set the kernels above are currently bound to.  */
+enum simd_level
+simd_level(void);
+
+/* Bind the kernels to the best instruction set not above LEVEL that the
+   running CPU supports and return it.  Mostly useful to check that every
+   kernel produces identical results.  Without it, the kernels are bound
+   to the best instruction set once, on first use or by `simd_level'.  */
+enum simd_level
+simd_use(enum simd_level level);
+
+#endif //TOK_LEXER_SIMD_H
@@ -20,13 +20,22 @@
  * Lexemn. If not, see <https://www.gnu.org/licenses/>.
  **/
 
+#include <math.h>
 #include <stdlib.h>
+
+/* Tests are checked by assertions, which must stay in optimized builds.  */
+#undef NDEBUG
 #include <assert.h>
 #include <stdio.h>
-#include <locale.h>
 #include <string.h>
+#include <threads.h>
+#include <unistd.h>
 
 #include "lexer.h"
+#include "lexer_cache.h"
+#include "lexer_simd.h"
+#include "lexer_trace.h"
+#include "utf8.h"
 
 /* Forward function declarations.  */
 
@@ -71,9 +80,11 @@ static struct lex_case const cases_table[] = {
 
 static char *const token_spellings[MAX_TOKENS] = {
 #define OP( name, _ ) "TOK_" #name ,
+#define KW( name, _ ) "TOK_" #name ,
 #define TOK( name, _ ) "TOK_" #name,
     TOK_TYPES_TABLE
 #undef TOK
+#undef KW
 #undef OP
 };
 
@@ -182,11 +193,1558 @@ test_lex(void)
     }
 }
 
-int
-main(void)
+/* Lex the LEN bytes at BUF, which need not be NUL-terminated, and check
+   that exactly the tokens in WANT are produced.  */
+static void
+check_bounded(char const *buf, size_t len,
+                    struct expect const *want, size_t n_want)
+{
+    struct tstream_t stream = { 0 };
+    struct lexer_t   lexer;
+
+    lex_setup_n(&lexer, (char unsigned const *) buf, len);
+    lex_start(&lexer, &stream);
+
+    assert(stream.size == 1 + n_want);
+    assert(stream.tokens[n_want].type == TOK_END);
+
+    for (size_t tok_idx = 0; tok_idx < n_want; ++tok_idx)
+    {
+        struct token_t const have = stream.tokens[tok_idx];
+
+        assert(have.type == want[tok_idx].type);
+
+        if (want[tok_idx].str)
+        {
+            assert(have.val.text.len == strlen(want[tok_idx].str));
+            assert(0 == memcmp(have.val.text.str, want[tok_idx].str, have.val.text.len));
+        }
+    }
+
+    free(stream.tokens);
+}
+
+static void
+test_lex_bounded(void)
+{
+    /* A sub-range of a larger buffer is lexed in place; nothing past the
+       range may leak into the tokens.  */
+    static char const shared[] = "foo bar:=baz \"quoted\" {{* note *}} tail";
+
+    check_bounded(shared + 4, 3, (struct expect[]) { { TOK_NAME, "bar" } }, 1);
+    check_bounded(shared + 4, 4, (struct expect[]) { { TOK_NAME, "bar" }, { TOK_COLON } }, 2);
+    check_bounded(shared + 13, 5, (struct expect[]) { { TOK_UNK }, { TOK_NAME, "quot" } }, 2);
+    check_bounded(shared + 22, 8, (struct expect[]) { { TOK_UNK } }, 1);
+    check_bounded(shared + 22, 12, nullptr, 0);
+
+    /* An embedded NUL no longer ends the input.  */
+    check_bounded("a\0b", 3, (struct expect[]) { { TOK_NAME, "a" }, { TOK_UNK }, { TOK_NAME, "b" } }, 3);
+
+    /* Multibyte characters cut by the end of the range.  */
+    check_bounded("größe", 3, (struct expect[]) { { TOK_NAME, "gr" }, { TOK_UNK } }, 2);
+    check_bounded("größe", 4, (struct expect[]) { { TOK_NAME, "grö" } }, 1);
+}
+
+/* Feed INPUT to a streaming lexer in chunks of CHUNK bytes, and check that
+   it produces the same tokens as lexing the whole of INPUT at once.  */
+static void
+check_stream(char const *const input, size_t const chunk)
+{
+    struct tstream_t whole  = { 0 };
+    struct tstream_t stream = { 0 };
+    struct lexer_t   lexer;
+    size_t const     len = strlen(input);
+    size_t           n   = 0;
+
+    lex_setup(&lexer, (char unsigned const *) input);
+    lex_start(&lexer, &whole);
+
+    lex_setup_stream(&lexer);
+
+    for (size_t off = 0; n < whole.size; off += chunk)
+    {
+        size_t const size = stream.size;
+
+        if (off < len)
+        {
+            size_t const part = len - off < chunk ? len - off : chunk;
+            int const    ret  = lex_feed(&lexer, (char unsigned const *) input + off, part, &stream);
+            assert(0 == ret);
+        }
+        else
+        {
+            lex_finish(&lexer, &stream);
+            assert(stream.size > size);
+        }
+
+        /* Token text is only valid until the next chunk is fed.  */
+        assert(stream.size - size <= whole.size - n);
+
+        for (size_t tok_idx = size; tok_idx < stream.size; ++tok_idx, ++n)
+        {
+            struct token_t const want = whole.tokens[n];
+            struct token_t const have = stream.tokens[tok_idx];
+
+            assert(want.type == have.type);
+            assert(want.pos == have.pos);
+
+            if (TOK_IS_LITERAL(want) || TOK_IS_IDENT(want))
+            {
+                assert(want.val.text.len == have.val.text.len);
+                assert(0 == memcmp(want.val.text.str, have.val.text.str, have.val.text.len));
+            }
+        }
+    }
+
+    assert(n == whole.size);
+
+    lex_free(&lexer);
+    free(whole.tokens);
+    free(stream.tokens);
+}
+
+static void
+test_lex_stream(void)
+{
+    constexpr size_t n_cases = sizeof(cases_table) / sizeof(cases_table[0]);
+    static size_t const chunks[] = { 1, 2, 3, 5, 16, 4096 };
+
+    for (size_t case_idx = 0; case_idx < n_cases; ++case_idx)
+        for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); ++i)
+            check_stream(cases_table[case_idx].input, chunks[i]);
+
+    /* Tokens split across chunks.  */
+    check_stream("x := 1.5 ... größe \"str ing\" \xE2\x8C\x8A {{* a *} *}} y", 1);
+    check_stream("x := 1.5 ... größe \"str ing\" \xE2\x8C\x8A {{* a *} *}} y", 2);
+    check_stream("{{*}} *}} z", 1);
+
+    /* A comment is never held in memory whole.  */
+    static char body[1 << 16];
+    memset(body, '*', sizeof(body));
+
+    struct tstream_t stream = { 0 };
+    struct lexer_t   lexer;
+
+    lex_setup_stream(&lexer);
+    assert(0 == lex_feed(&lexer, (char unsigned const *) "{{*", 3, &stream));
+
+    for (size_t off = 0; off < sizeof(body); off += 16)
+    {
+        assert(0 == lex_feed(&lexer, (char unsigned const *) body + off, 16, &stream));
+        assert(lexer.carry_cap <= 64);
+    }
+
+    assert(0 == lex_feed(&lexer, (char unsigned const *) "}} end", 6, &stream));
+    lex_finish(&lexer, &stream);
+
+    assert(2 == stream.size);
+    assert(TOK_NAME == stream.tokens[0].type);
+    assert(TOK_END == stream.tokens[1].type);
+
+    lex_free(&lexer);
+
+    /* A string or an argument of a meta-command is held whole, but fed a
+       byte at a time, the search for its end goes on from where it stopped
+       rather than from its start, which would take quadratic time.  */
+    size_t const   n    = (size_t) 1 << 18;
+    char *const    text = malloc(2 * n + 32);
+    size_t         len  = 0;
+
+    assert(text);
+
+    len += (size_t) sprintf(text + len, "x \"");
+    memset(text + len, 'a', n);
+    memcpy(text + len + n / 2, "\\\"", 2);
+    len += n;
+    len += (size_t) sprintf(text + len, "\" \\cmd ");
+    memset(text + len, 'b', n);
+    len += n;
+    len += (size_t) sprintf(text + len, " 'q q'");
+
+    size_t const string_at = 2;
+    size_t const arg_at    = string_at + n + 2 + 6;
+
+    tstream_reset(&stream);
+    lex_setup_stream(&lexer);
+
+    for (size_t fed = 0; fed < len; ++fed)
+    {
+        assert(0 == lex_feed(&lexer, (char unsigned const *) text + fed, 1, &stream));
+
+        /* Held as soon as the token before it is past the lookahead.  */
+        if ((fed > string_at + 8 && fed < string_at + n) || (fed > arg_at + 8 && fed < arg_at + n))
+            assert(fed + 1 == lexer.held_scanned);
+    }
+
+    assert(0 == lex_finish(&lexer, &stream));
+
+    assert(6 == stream.size);
+    assert(TOK_STRING == stream.tokens[1].type);
+    assert(n == stream.tokens[1].val.text.len);
+    assert(TOK_CMD == stream.tokens[2].type);
+    assert(TOK_CMD_ARG == stream.tokens[3].type);
+    assert(arg_at == stream.tokens[3].pos);
+    assert(n == stream.tokens[3].val.text.len);
+    assert(5 == stream.tokens[4].val.text.len);
+
+    lex_free(&lexer);
+    free(stream.tokens);
+    free(text);
+}
+
+/* Check that pulling the tokens of each test case one at a time, with some
+   lookahead, yields exactly what lexing the whole input at once does.  */
+static void
+test_lex_next(void)
+{
+    constexpr size_t n_cases = sizeof(cases_table) / sizeof(cases_table[0]);
+
+    for (size_t case_idx = 0; case_idx < n_cases; ++case_idx)
+    {
+        char unsigned const *const input  = (char unsigned const *) cases_table[case_idx].input;
+        struct tstream_t           whole  = { 0 };
+        struct lexer_t             lexer;
+        struct token_t             tok;
+        struct token_t             ahead;
+
+        lex_setup(&lexer, input);
+        lex_start(&lexer, &whole);
+
+        lex_setup(&lexer, input);
+
+        for (size_t tok_idx = 0; tok_idx < whole.size; ++tok_idx)
+        {
+            /* Peeking never consumes a token.  */
+            for (size_t n = 0; n < 3; ++n)
+            {
+                bool const more = lex_peek(&lexer, n, &ahead);
+
+                assert(more == (tok_idx + n + 1 < whole.size));
+                assert(ahead.type == whole.tokens[more ? tok_idx + n : whole.size - 1].type);
+            }
+
+            bool const more = lex_next(&lexer, &tok);
+            struct token_t const want = whole.tokens[tok_idx];
+
+            assert(more == (TOK_END != want.type));
+            assert(tok.type == want.type);
+            assert(tok.val.text.str == want.val.text.str);
+            assert(tok.val.text.len == want.val.text.len);
+        }
+
+        /* The end is sticky.  */
+        assert(!lex_next(&lexer, &tok));
+        assert(TOK_END == tok.type);
+
+        lex_free(&lexer);
+        free(whole.tokens);
+    }
+}
+
+/* Check that the compact stream of INPUT holds the same tokens as the
+   regular one.  */
+static void
+check_compact(char const *const input)
+{
+    struct tstream_t  whole   = { 0 };
+    struct ctstream_t compact = { 0 };
+    struct lexer_t    lexer;
+
+    lex_setup(&lexer, (char unsigned const *) input);
+    lex_start(&lexer, &whole);
+
+    lex_setup(&lexer, (char unsigned const *) input);
+    assert(0 == lex_start_compact(&lexer, &compact));
+    lex_free(&lexer);
+
+    assert(compact.size == whole.size);
+
+    for (size_t tok_idx = 0; tok_idx < whole.size; ++tok_idx)
+    {
+        struct token_t const want = whole.tokens[tok_idx];
+        struct token_t const have = ctstream_get(&compact, (char unsigned const *) input, tok_idx);
+
+        assert(want.type == have.type);
+        assert(want.pos == have.pos);
+        assert(want.flags == have.flags);
+        assert(want.val.text.len == have.val.text.len);
+
+        if (want.val.text.len > 0)
+            assert(want.val.text.str == have.val.text.str);
+    }
+
+    free(whole.tokens);
+    ctstream_free(&compact);
+}
+
+static void
+test_lex_compact(void)
+{
+    constexpr size_t n_cases = sizeof(cases_table) / sizeof(cases_table[0]);
+
+    for (size_t case_idx = 0; case_idx < n_cases; ++case_idx)
+        check_compact(cases_table[case_idx].input);
+
+    /* Long enough to need several rank samples.  */
+    static char input[4096];
+    for (size_t len = 0; len + 16 < sizeof(input); len += 16)
+        memcpy(input + len, len % 48 ? "x := \"s\" + 1;   " : "{{* c *}} [a]   ", 16);
+
+    check_compact(input);
+
+    /* Problems keep their kind, wherever they fall between rank samples.  */
+    check_compact("x ` 1 $ 089 \\ y \xff \"s");
+
+    for (size_t len = 0; len + 16 < sizeof(input); len += 16)
+        memcpy(input + len, len % 48 ? "x := 089 ` $ 1; " : "{{* c *}} [a] ` ", 16);
+
+    check_compact(input);
+}
+
+/* Sources past 4 GiB cannot be held in memory here, so they are faked by
+   starting the offsets of a small one right below the limit.  */
+static void
+test_lex_too_large(void)
+{
+    char unsigned const *const input = (char unsigned const *) "ab cd";
+    size_t const               len   = 5;
+    size_t const               fits  = UINT32_MAX - len;
+
+    struct tstream_t  stream  = { 0 };
+    struct ctstream_t compact = { 0 };
+    struct lexer_t    lexer;
+    struct token_t    tok;
+
+    for (size_t base = fits; base <= fits + 1; ++base)
+    {
+        int const want = base == fits ? 0 : -1;
+
+        tstream_reset(&stream);
+        lex_setup_n(&lexer, input, len);
+        lexer.base = base;
+        assert(want == lex_start(&lexer, &stream));
+        assert((0 == want ? 3u : 0u) == stream.size);
+        assert(0 != want || UINT32_MAX == stream.tokens[2].pos);
+
+        lex_setup_n(&lexer, input, len);
+        lexer.base = base;
+        assert(want == lex_relex(&lexer, &stream, 0, 1, 1));
+
+        tstream_reset(&stream);
+        lex_setup_n(&lexer, input, len);
+        lexer.base = base;
+        assert(want == lex_start_parallel(&lexer, &stream, 4));
+
+        lex_setup_n(&lexer, input, len);
+        lexer.base = base;
+        assert(want == lex_start_compact(&lexer, &compact));
+        ctstream_free(&compact);
+
+        lex_setup_n(&lexer, input, len);
+        lexer.base = base;
+        assert((0 == want) == lex_next(&lexer, &tok));
+        assert((0 != want) == lexer.queue.failed);
+        lex_free(&lexer);
+
+        tstream_reset(&stream);
+        lex_setup_stream(&lexer);
+        lexer.base = base;
+        assert(0 == lex_feed(&lexer, input, 3, &stream));
+        assert(want == lex_feed(&lexer, input + 3, 2, &stream));
+        assert(0 == lex_finish(&lexer, &stream));
+        lex_free(&lexer);
+    }
+
+    tstream_free(&stream);
+}
+
+static void
+test_lex_symtab(void)
+{
+    struct symtab_t  table  = { 0 };
+    struct tstream_t stream = { 0 };
+    struct lexer_t   lexer;
+
+    lex_setup(&lexer, (char unsigned const *) "x := größe + x * $PI / größe2 + PI + $PI + \"x\"");
+    lexer.symtab = &table;
+    lex_start(&lexer, &stream);
+
+    struct token_t const *const tok = stream.tokens;
+
+    /* Equal names share an id, and different ones do not.  */
+    assert(SYM_NONE != tok[0].sym);
+    assert(tok[0].sym == tok[4].sym);
+    assert(tok[2].sym != tok[8].sym);
+    assert(tok[6].sym == tok[12].sym);
+    assert(tok[6].sym != tok[10].sym);
+    assert(SYM_NONE == tok[14].sym);
+    assert(5 == table.size - 1);
+
+    struct identifier const *const sym = symtab_get(&table, tok[2].sym);
+    assert(sym->len == strlen("größe"));
+    assert(0 == strcmp((char const *) sym->name, "größe"));
+    assert(sym->hash == sym_hash(sym->name, sym->len));
+
+    /* Plenty of names, so that the table has to grow.  */
+    char name[16];
+    for (unsigned i = 0; i < 10000; ++i)
+    {
+        int const      len = snprintf(name, sizeof(name), "n%u", i % 5000);
+        uint32_t const id  = symtab_intern(&table, (char unsigned const *) name, (size_t) len,
+                                           sym_hash((char unsigned const *) name, (size_t) len));
+
+        assert(id == (i < 5000 ? 6 + i : 6 + i - 5000));
+    }
+
+    free(stream.tokens);
+    symtab_free(&table);
+}
+
+/* Allocator that refuses to hand out more than a fixed amount of bytes.  */
+static void *
+tight_resize(void *const ctx, void *const ptr, size_t const size, size_t const new_size)
+{
+    size_t *const left = ctx;
+
+    if (new_size > *left)
+        return nullptr;
+
+    *left -= new_size;
+    (void) size;
+    return realloc(ptr, new_size);
+}
+
+static void
+tight_release(void *const ctx, void *const ptr, size_t const size)
+{
+    (void) ctx;
+    (void) size;
+    free(ptr);
+}
+
+static void
+test_lex_alloc(void)
+{
+    char unsigned const *const input = (char unsigned const *) "a + b * (c - 1) ; d := \"e\" ;";
+
+    /* A stream reset between runs reuses its memory.  */
+    struct arena_t           arena  = { 0 };
+    struct allocator_t const alloc  = arena_allocator(&arena);
+    struct tstream_t         stream = { .alloc = &alloc };
+    struct lexer_t           lexer;
+
+    lex_setup(&lexer, input);
+    assert(0 == lex_start(&lexer, &stream));
+
+    struct token_t const *const tokens = stream.tokens;
+    size_t const                size   = stream.size;
+
+    for (int i = 0; i < 100; ++i)
+    {
+        tstream_reset(&stream);
+        lex_setup(&lexer, input);
+        assert(0 == lex_start(&lexer, &stream));
+        assert(tokens == stream.tokens && size == stream.size);
+    }
+
+    tstream_free(&stream);
+    arena_free(&arena);
+
+    /* Running out of memory is reported, and the tokens that made it into
+       the stream are still there.  */
+    size_t                   left  = 10 * sizeof(struct token_t);
+    struct allocator_t const tight = { tight_resize, tight_release, &left };
+
+    stream = (struct tstream_t) { .alloc = &tight };
+    lex_setup(&lexer, input);
+    assert(-1 == lex_start(&lexer, &stream));
+    assert(stream.failed);
+    assert(8 == stream.size);
+    assert(TOK_NAME == stream.tokens[0].type);
+
+    tstream_free(&stream);
+}
+
+/* Check that lexing INPUT on several threads yields exactly what lexing it
+   on a single one does.  */
+static void
+check_parallel(char const *const input, size_t const len)
+{
+    struct symtab_t  seq_table = { 0 }, par_table = { 0 };
+    struct tstream_t want = { 0 }, have = { 0 };
+    struct lexer_t   lexer;
+
+    lex_setup_n(&lexer, (char unsigned const *) input, len);
+    lexer.symtab = &seq_table;
+    assert(0 == lex_start(&lexer, &want));
+
+    for (unsigned nthreads = 1; nthreads <= 8; nthreads *= 2)
+    {
+        tstream_reset(&have);
+        lex_setup_n(&lexer, (char unsigned const *) input, len);
+        lexer.symtab = &par_table;
+        assert(0 == lex_start_parallel(&lexer, &have, nthreads));
+        assert(want.size == have.size);
+
+        for (size_t i = 0; i < want.size; ++i)
+        {
+            assert(want.tokens[i].type == have.tokens[i].type);
+            assert(want.tokens[i].pos == have.tokens[i].pos);
+            assert(want.tokens[i].sym == have.tokens[i].sym);
+            assert(want.tokens[i].val.text.len == have.tokens[i].val.text.len);
+            assert(want.tokens[i].val.text.str == have.tokens[i].val.text.str);
+        }
+
+        symtab_free(&par_table);
+        par_table = (struct symtab_t) { 0 };
+    }
+
+    tstream_free(&want);
+    tstream_free(&have);
+    symtab_free(&seq_table);
+}
+
+/* Start no thread at all, as if there were no room for their stacks.  */
+static int
+test_thrd_none(thrd_t *const thread, thrd_start_t const func, void *const arg)
+{
+    (void) thread;
+    (void) func;
+    (void) arg;
+    return thrd_nomem;
+}
+
+/* Start every other thread only.  */
+static int
+test_thrd_some(thrd_t *const thread, thrd_start_t const func, void *const arg)
+{
+    static unsigned calls;
+
+    return 1 & ++calls ? thrd_create(thread, func, arg) : thrd_nomem;
+}
+
+static void
+test_lex_parallel(void)
+{
+    static char const *const pieces[] = {
+        "x", "größe", "$PI", "42", "3.14", ":=", "+", "*", "(", ")", "⌊", ";",
+        "\"str ing\"", "\"a {{* b\"", "{{* c d *}}", "{{* e \" f *}}", "\n", "  ",
+    };
+
+    constexpr size_t n_pieces = sizeof(pieces) / sizeof(pieces[0]);
+    size_t const     size     = (size_t) 1 << 20;
+    char *const      input    = malloc(size);
+    size_t           len      = 0;
+    uint32_t         seed     = 1;
+
+    assert(input);
+
+    while (len < size - 4096)
+    {
+        seed = seed * 1103515245 + 12345;
+
+        /* Every now and then, a comment or a string long enough to hide a
+           whole piece of the input from the thread that scans it.  */
+        if (0 == (seed >> 8) % 512)
+        {
+            bool const comment = (seed >> 20) & 1;
+            size_t const body  = (seed >> 4) % 3000;
+
+            memcpy(input + len, comment ? "{{* " : "\"", comment ? 4 : 1);
+            len += comment ? 4 : 1;
+            memset(input + len, ' ', body);
+            len += body;
+            memcpy(input + len, comment ? " *}} " : "\" ", comment ? 5 : 2);
+            len += comment ? 5 : 2;
+            continue;
+        }
+
+        char const *const piece = pieces[(seed >> 8) % n_pieces];
+        size_t const      n     = strlen(piece);
+
+        memcpy(input + len, piece, n);
+        input[len + n] = ' ';
+        len += n + 1;
+    }
+
+    /* Threads use the kernels bound by `simd_use', never rebinding them.  */
+    enum simd_level const level = simd_level();
+
+    check_parallel(input, len);
+    assert(level == simd_level());
+
+    /* Ends within an unterminated comment, or within a meta-command.  */
+    memcpy(input + len, "{{* x", 5);
+    check_parallel(input, len + 5);
+    memcpy(input + len / 2, "\\cmd a", 6);
+    check_parallel(input, len);
+
+    /* Threads that cannot be started leave their pieces to the stitching.  */
+    lex_thrd_create = test_thrd_none;
+    check_parallel(input, len / 2);
+    lex_thrd_create = test_thrd_some;
+    check_parallel(input, len / 2);
+    lex_thrd_create = thrd_create;
+
+    free(input);
+}
+
+/* Return the first byte in [P, END) not in a well-formed sequence, one
+   character at a time.  */
+static char unsigned const *
+utf8_first_invalid(char unsigned const *p, char unsigned const *const end)
+{
+    char32_t c32;
+
+    while (p < end)
+    {
+        size_t const len = utf8_decode(&c32, p, end);
+        if (UTF8_INVALID == len || UTF8_TRUNCATED == len)
+            return p;
+
+        p += len;
+    }
+
+    return p;
+}
+
+static void
+test_lex_validate(void)
 {
-    setlocale(LC_ALL, "");
-    test_lex();
+    static char const *const pieces[] = {
+        "a", "  ", "x := 1;", "größe", "水", "🍌", "сумма", "\xF4\x8F\xBF\xBF", "\xEF\xBF\xBF",
+        "\x80", "\xC0\x80", "\xC2", "\xE0\x9F\xBF", "\xED\xA0\x80", "\xF0\x8F\xBF\xBF",
+        "\xF4\x90\x80\x80", "\xF5\x80\x80\x80", "\xFF", "\xE2\x8C", "\xF0\x9F\x8D",
+    };
+
+    constexpr size_t n_pieces = sizeof(pieces) / sizeof(pieces[0]);
+    constexpr size_t n_valid  = 9;
+    static char unsigned buf[512];
+    uint32_t             seed = 1;
+
+    /* Every kind of error, at every position within a vector and after
+       plenty of valid input.  */
+    for (int round = 0; round < 20000; ++round)
+    {
+        size_t len = 0;
+
+        while (true)
+        {
+            seed = seed * 1103515245 + 12345;
+
+            /* Mostly valid pieces, so the error is not always early.  */
+            size_t const      pick  = (seed >> 8) % (0 == (seed >> 20) % 8 ? n_pieces : n_valid);
+            char const *const piece = pieces[pick];
+            size_t const      n     = strlen(piece);
+
+            if (len + n > sizeof(buf) - (seed >> 24) % 64)
+                break;
+
+            memcpy(buf + len, piece, n);
+            len += n;
+        }
+
+        for (size_t from = 0; from < 4 && from <= len; ++from)
+            assert(simd_utf8_validate(buf + from, buf + len) == utf8_first_invalid(buf + from, buf + len));
+    }
+
+    /* A trusted lexer scans exactly what an untrusted one does.  */
+    char unsigned const *const input = (char unsigned const *) "x := größe ∩ 水 ÷ \"🍌\" + $π {{* Ø *}} ⌊y⌋";
+    struct tstream_t want = { 0 }, have = { 0 };
+    struct lexer_t   lexer;
+
+    lex_setup(&lexer, input);
+    assert(0 == lex_start(&lexer, &want));
+
+    lex_setup(&lexer, input);
+    assert((size_t) -1 == lex_validate(&lexer));
+    assert(lexer.trusted);
+    assert(0 == lex_start(&lexer, &have));
+
+    assert(want.size == have.size);
+    for (size_t i = 0; i < want.size; ++i)
+    {
+        assert(want.tokens[i].type == have.tokens[i].type);
+        assert(want.tokens[i].pos == have.tokens[i].pos);
+        assert(want.tokens[i].val.text.len == have.tokens[i].val.text.len);
+    }
+
+    /* The offset of the first bad byte is that of the source as a whole.  */
+    lex_setup(&lexer, (char unsigned const *) "größe \xE2\x8C");
+    assert(strlen("größe ") == lex_validate(&lexer));
+    assert(!lexer.trusted);
+
+    tstream_free(&want);
+    tstream_free(&have);
+}
+
+static void
+test_lex_number(void)
+{
+    static struct
+    {
+        char const *input;
+        char const *text;   /* Text of the number, if not the whole input.  */
+        uint8_t     flags;
+        int64_t     value;
+        double      real;
+    } const numbers[] = {
+        { "0",                       nullptr, TOK_NUM_INT, 0 },
+        { "42",                      nullptr, TOK_NUM_INT, 42 },
+        { "12345678",                nullptr, TOK_NUM_INT, 12345678 },
+        { "1234567890123456789",     nullptr, TOK_NUM_INT, INT64_C(1234567890123456789) },
+        { "9223372036854775807",     nullptr, TOK_NUM_INT, INT64_MAX },
+        { "9223372036854775808",     nullptr, TOK_NUM_INT | TOK_NUM_OVERFLOW, INT64_MAX },
+        { "99999999999999999999999", nullptr, TOK_NUM_INT | TOK_NUM_OVERFLOW, INT64_MAX },
+        { "1_000_000",               nullptr, TOK_NUM_INT, 1000000 },
+        { "1_000_",                  "1_000", TOK_NUM_INT, 1000 },
+        { "0x0",                     nullptr, TOK_NUM_INT, 0 },
+        { "0XFF80",                  nullptr, TOK_NUM_INT, 0xFF80 },
+        { "0xabcdef",                nullptr, TOK_NUM_INT, 0xABCDEF },
+        { "0xFF_FF_00_00",           nullptr, TOK_NUM_INT, 0xFFFF0000 },
+        { "0x7FFFFFFFFFFFFFFF",      nullptr, TOK_NUM_INT, INT64_MAX },
+        { "0x8000000000000000",      nullptr, TOK_NUM_INT | TOK_NUM_OVERFLOW, INT64_MAX },
+        { "0xg",                     "0",     TOK_NUM_INT, 0 },
+        { "0b1111_0000_1010_0101",   nullptr, TOK_NUM_INT, 0xF0A5 },
+        { "0B11001010",              nullptr, TOK_NUM_INT, 0xCA },
+        { "0b2",                     "0",     TOK_NUM_INT, 0 },
+        { "0o755",                   nullptr, TOK_NUM_INT, 0755 },
+        { "0O123_456",               nullptr, TOK_NUM_INT, 0123456 },
+        { "0755",                    nullptr, TOK_NUM_INT, 755 },
+        { "0000007",                 nullptr, TOK_NUM_INT, 7 },
+        { "09",                      nullptr, TOK_NUM_INT, 9 },
+        { "3.14159",                 nullptr, TOK_NUM_REAL, 0, 3.14159 },
+        { "1.e2",                    nullptr, TOK_NUM_REAL, 0, 100.0 },
+        { ".5e-3",                   nullptr, TOK_NUM_REAL, 0, 0.0005 },
+        { "1.6E-19",                 nullptr, TOK_NUM_REAL, 0, 1.6e-19 },
+        { "6.022e+23",               nullptr, TOK_NUM_REAL, 0, 6.022e23 },
+        { "1_000.000_1",             nullptr, TOK_NUM_REAL, 0, 1000.0001 },
+        { "1e400",                   nullptr, TOK_NUM_REAL | TOK_NUM_OVERFLOW, 0, HUGE_VAL },
+        { "1e-400",                  nullptr, TOK_NUM_REAL, 0, 0.0 },
+        { ".e5",                     ".",     0, 0, 0 },
+        { "1e",                      "1",     TOK_NUM_INT, 1 },
+        { "2e+x",                    "2",     TOK_NUM_INT, 2 },
+    };
+
+    for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); ++i)
+    {
+        char const *const text = numbers[i].text ? numbers[i].text : numbers[i].input;
+        struct tstream_t  stream = { 0 };
+        struct ctstream_t compact = { 0 };
+        struct lexer_t    lexer;
+
+        lex_setup(&lexer, (char unsigned const *) numbers[i].input);
+        assert(0 == lex_start(&lexer, &stream));
+
+        lex_setup(&lexer, (char unsigned const *) numbers[i].input);
+        assert(0 == lex_start_compact(&lexer, &compact));
+
+        struct token_t const tok   = stream.tokens[0];
+        struct token_t const again = ctstream_get(&compact, (char unsigned const *) numbers[i].input, 0);
+
+        assert(TOK_NUMBER == tok.type);
+        assert(strlen(text) == tok.val.text.len);
+        assert(numbers[i].flags == tok.flags);
+        assert(!(tok.flags & TOK_NUM_INT) || numbers[i].value == tok.ival);
+        assert(!(tok.flags & TOK_NUM_REAL) || numbers[i].real == tok.fval);
+
+        assert(tok.flags == again.flags);
+        assert(!(tok.flags & TOK_NUM_INT) || tok.ival == again.ival);
+        assert(!(tok.flags & TOK_NUM_REAL) || tok.fval == again.fval);
+
+        tstream_free(&stream);
+        ctstream_free(&compact);
+    }
+}
+
+/* Check that real numbers are rounded exactly like `strtod' does.  */
+static void
+test_lex_real(void)
+{
+    static char const *const hard[] = {
+        /* Long mantissas, which take the slow path.  */
+        "2.2564588546514416484811541587844554862946141165451561651888",
+        "9007199254740993.00000000000000000000000000000000000000000001",
+        "2.47032822920623272088284396434110686182529901307162382212792841250337753635104375932649918180817996189898282347722858865463328355177969898199387398005390939063150356595155702263922908583924491051844359318028499365361525003193704576782492193656236698636584807570351308e-324",
+        /* Halfway between two doubles, and just past it.  */
+        "9007199254740993.0", "9007199254740993.0000000000000000001",
+        "1.00000000000000011102230246251565404236316680908203125",
+        "1.00000000000000011102230246251565404236316680908203124",
+        /* Edges of the range.  */
+        "1.7976931348623157e308", "1.7976931348623159e308", "4.9406564584124654e-324",
+        "2.2250738585072011e-308", "2.2250738585072014e-308", "2.4703282292062327e-324",
+        "2.4703282292062328e-324", "0.000000000000000000000000000000000000000000001e-300",
+    };
+
+    for (size_t i = 0; i < sizeof(hard) / sizeof(hard[0]); ++i)
+    {
+        struct tstream_t stream = { 0 };
+        struct lexer_t   lexer;
+
+        lex_setup(&lexer, (char unsigned const *) hard[i]);
+        assert(0 == lex_start(&lexer, &stream));
+        assert(TOK_NUMBER == stream.tokens[0].type && TOK_END == stream.tokens[1].type);
+        assert(strtod(hard[i], nullptr) == stream.tokens[0].fval);
+
+        tstream_free(&stream);
+    }
+
+    /* Plenty of random ones, from a few digits to many more than fit in a
+       64-bit mantissa, with exponents all over the range.  */
+    char     buf[128];
+    uint32_t seed = 7;
+
+    for (int round = 0; round < 100000; ++round)
+    {
+        size_t n = 0;
+
+        seed = seed * 1103515245 + 12345;
+        size_t const ndigits = 1 + (seed >> 8) % ((seed >> 28) ? 20 : 60);
+        size_t const point   = (seed >> 16) % (ndigits + 1);
+
+        for (size_t d = 0; d < ndigits; ++d)
+        {
+            if (d == point)
+                buf[n++] = '.';
+
+            seed = seed * 1103515245 + 12345;
+            buf[n++] = (char) ('0' + (seed >> 16) % 10);
+        }
+
+        seed = seed * 1103515245 + 12345;
+        n += (size_t) snprintf(buf + n, sizeof(buf) - n, "e%d", (int) ((seed >> 8) % 700) - 350);
+
+        struct tstream_t stream = { 0 };
+        struct lexer_t   lexer;
+
+        lex_setup_n(&lexer, (char unsigned const *) buf, n);
+        assert(0 == lex_start(&lexer, &stream));
+        assert(stream.tokens[0].flags & TOK_NUM_REAL);
+        assert(n == stream.tokens[0].val.text.len);
+
+        buf[n] = '\0';
+        double const want = strtod(buf, nullptr);
+        assert(0 == memcmp(&want, &stream.tokens[0].fval, sizeof(want)));
+
+        tstream_free(&stream);
+    }
+}
+
+static void
+test_lex_keyword(void)
+{
+    static struct
+    {
+        enum token_type type;
+        char const     *spelling;
+    } const keywords[] = {
+#define OP( name, _ )
+#define KW( name, spelling ) { TOK_ ## name, spelling },
+#define TOK( name, _ )
+        TOK_TYPES_TABLE
+#undef TOK
+#undef KW
+#undef OP
+    };
+
+    /* Every keyword is recognized, and so is nothing that merely looks
+       like one.  */
+    for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); ++i)
+    {
+        char input[32];
+        snprintf(input, sizeof(input), "%s %sx _%s %.*s", keywords[i].spelling,
+                 keywords[i].spelling, keywords[i].spelling,
+                 (int) strlen(keywords[i].spelling) - 1, keywords[i].spelling);
+
+        struct tstream_t stream = { 0 };
+        struct lexer_t   lexer;
+
+        lex_setup(&lexer, (char unsigned const *) input);
+        lex_start(&lexer, &stream);
+
+        assert(5 == stream.size);
+        assert(keywords[i].type == stream.tokens[0].type);
+        assert(0 == stream.tokens[0].val.text.len);
+        assert(TOK_NAME == stream.tokens[1].type);
+        assert(TOK_NAME == stream.tokens[2].type);
+        assert(TOK_NAME == stream.tokens[3].type);
+
+        tstream_free(&stream);
+        check_compact(input);
+    }
+
+    /* Keywords never make it into the symbol table.  */
+    struct symtab_t  table  = { 0 };
+    struct tstream_t stream = { 0 };
+    struct lexer_t   lexer;
+
+    lex_setup(&lexer, (char unsigned const *) "func f(x: int): bool { return x ∈ Int; }");
+    lexer.symtab = &table;
+    lex_start(&lexer, &stream);
+
+    enum token_type const want[] = {
+        TOK_FUNC, TOK_NAME, TOK_LPAREN, TOK_NAME, TOK_COLON, TOK_INT, TOK_RPAREN,
+        TOK_COLON, TOK_BOOL, TOK_LBRACE, TOK_RETURN, TOK_NAME, TOK_SET_ELEMOF,
+        TOK_NAME, TOK_SEMICOLON, TOK_RBRACE, TOK_END
+    };
+
+    assert(sizeof(want) / sizeof(want[0]) == stream.size);
+    for (size_t i = 0; i < stream.size; ++i)
+        assert(want[i] == stream.tokens[i].type);
+
+    assert(3 == table.size - 1);
+    assert(SYM_NONE == stream.tokens[0].sym);
+
+    tstream_free(&stream);
+    symtab_free(&table);
+}
+
+/* Lex INPUT and check that it produces exactly the N tokens of types WANT.  */
+static void
+check_types(char const *const input, enum token_type const *const want, size_t const n)
+{
+    struct tstream_t stream = { 0 };
+    struct lexer_t   lexer;
+
+    lex_setup(&lexer, (char unsigned const *) input);
+    lex_start(&lexer, &stream);
+
+    assert(1 + n == stream.size);
+    for (size_t i = 0; i < n; ++i)
+        assert(want[i] == stream.tokens[i].type);
+
+    tstream_free(&stream);
+}
+
+#define CHECK_TYPES( input, ... ) \
+    check_types(input, (enum token_type const[]) { __VA_ARGS__ }, \
+                sizeof((enum token_type const[]) { __VA_ARGS__ }) / sizeof(enum token_type))
+
+static void
+test_lex_operator(void)
+{
+    static struct
+    {
+        enum token_type type;
+        char const     *spelling;
+    } const operators[] = {
+#define OP( name, spelling ) { TOK_ ## name, spelling },
+#define KW( name, _ )
+#define TOK( name, _ )
+        TOK_TYPES_TABLE
+#undef TOK
+#undef KW
+#undef OP
+    };
+
+    /* Every operator is recognized on its own, right before another one
+       and cut short by the end of the input.  */
+    for (size_t i = 0; i < sizeof(operators) / sizeof(operators[0]); ++i)
+    {
+        char input[16];
+        size_t const len = strlen(operators[i].spelling);
+
+        snprintf(input, sizeof(input), "%s", operators[i].spelling);
+        CHECK_TYPES(input, operators[i].type);
+
+        snprintf(input, sizeof(input), "%s (", operators[i].spelling);
+        CHECK_TYPES(input, operators[i].type, TOK_LPAREN);
+
+        struct tstream_t stream = { 0 };
+        struct lexer_t   lexer;
+
+        lex_setup_n(&lexer, (char unsigned const *) operators[i].spelling, len - 1);
+        lex_start(&lexer, &stream);
+
+        for (size_t j = 0; j + 1 < stream.size; ++j)
+            assert(operators[i].type != stream.tokens[j].type);
+
+        tstream_free(&stream);
+    }
+
+    /* The longest operator wins.  */
+    CHECK_TYPES("<<=",  TOK_LSHIFT, TOK_EQ);
+    CHECK_TYPES("<>=",  TOK_NEQ_2, TOK_EQ);
+    CHECK_TYPES("***",  TOK_EXP, TOK_MULT);
+    CHECK_TYPES("+++",  TOK_INC, TOK_PLUS);
+    CHECK_TYPES(":==",  TOK_ASSIGN, TOK_EQ);
+    CHECK_TYPES("....", TOK_ELLIPSIS, TOK_NUMBER);
+    CHECK_TYPES("..5",  TOK_RANGE, TOK_NUMBER);
+    CHECK_TYPES("∈∉×÷", TOK_SET_ELEMOF, TOK_SET_NELEMOF, TOK_SET_CARTPROD, TOK_DIV_2);
+    CHECK_TYPES("ØA AØ", TOK_SET_EMPTY, TOK_NAME, TOK_NAME);
+    CHECK_TYPES("{{* c *}}{", TOK_LBRACE);
+}
+
+static void
+test_lex_const(void)
+{
+    static struct
+    {
+        char const    *input;
+        enum lex_const cid;
+        double         value;
+    } const consts[] = {
+        { "$E",        CONST_E,        2.7182818284590452354  },
+        { "$PI",       CONST_PI,       3.14159265358979323846 },
+        { "$PI_2",     CONST_PI_2,     1.57079632679489661923 },
+        { "$1_PI",     CONST_1_PI,     0.31830988618379067154 },
+        { "$2_SQRTPI", CONST_2_SQRTPI, 1.12837916709551257390 },
+        { "$SQRT1_2",  CONST_SQRT1_2,  0.70710678118654752440 },
+        { "$pi",       CONST_NONE,     0 },
+        { "$PI_",      CONST_NONE,     0 },
+        { "$PI_3",     CONST_NONE,     0 },
+        { "$SQRT",     CONST_NONE,     0 },
+        { "$x",        CONST_NONE,     0 },
+    };
+
+    for (size_t i = 0; i < sizeof(consts) / sizeof(consts[0]); ++i)
+    {
+        struct tstream_t stream = { 0 };
+        struct lexer_t   lexer;
+
+        lex_setup(&lexer, (char unsigned const *) consts[i].input);
+        lex_start(&lexer, &stream);
+
+        struct token_t const tok = stream.tokens[0];
+
+        assert(TOK_CONST == tok.type);
+        assert(strlen(consts[i].input) == tok.val.text.len);
+        assert(consts[i].cid == tok.cid);
+        assert((CONST_NONE == consts[i].cid) == !!(tok.flags & TOK_CONST_UNKNOWN));
+
+        if (CONST_NONE != consts[i].cid)
+            assert(consts[i].value == lex_const_value(tok.cid));
+
+        struct ctstream_t compact = { 0 };
+
+        lex_setup(&lexer, (char unsigned const *) consts[i].input);
+        assert(0 == lex_start_compact(&lexer, &compact));
+
+        struct token_t const again = ctstream_get(&compact, (char unsigned const *) consts[i].input, 0);
+        assert(tok.cid == again.cid);
+        assert(tok.flags == again.flags);
+
+        tstream_free(&stream);
+        ctstream_free(&compact);
+    }
+
+    assert(isnan(lex_const_value(CONST_NONE)));
+}
+
+static void
+test_lex_position(void)
+{
+    static char const source[] = "x := 1\n"
+                                 "\n"
+                                 "größe := {x ∈ A}\n"
+                                 "  \"水\" + y";
+
+    struct tstream_t stream = { 0 };
+    struct lexer_t   lexer;
+
+    lex_setup(&lexer, (char unsigned const *) source);
+    lex_start(&lexer, &stream);
+
+    static struct position_t const want[] = {
+        { 1, 1 }, { 1, 3 }, { 1, 6 },
+        { 3, 1 }, { 3, 7 }, { 3, 10 }, { 3, 11 }, { 3, 13 }, { 3, 15 }, { 3, 16 },
+        { 4, 3 }, { 4, 7 }, { 4, 9 },
+        { 4, 10 },
+    };
+
+    assert(sizeof(want) / sizeof(want[0]) == stream.size);
+
+    for (size_t i = 0; i < stream.size; ++i)
+    {
+        struct position_t const have = lex_position(&lexer, stream.tokens[i].pos);
+
+        assert(want[i].line == have.line);
+        assert(want[i].column == have.column);
+    }
+
+    /* A line feed is the last character of its line.  */
+    struct position_t have = lex_position(&lexer, 6);
+    assert(1 == have.line && 7 == have.column);
+
+    have = lex_position(&lexer, 7);
+    assert(2 == have.line && 1 == have.column);
+
+    assert(0 == lex_position(&lexer, sizeof(source)).line);
+
+    tstream_free(&stream);
+    lex_free(&lexer);
+
+    /* Line feeds in all positions of the vector blocks, and none at all.  */
+    char long_source[300];
+
+    for (size_t i = 0; i < sizeof(long_source); ++i)
+        long_source[i] = i % 7 == 3 || i % 31 == 0 ? '\n' : 'a';
+
+    for (size_t skew = 0; skew < 40; ++skew)
+    {
+        size_t const len = sizeof(long_source) - skew;
+
+        lex_setup_n(&lexer, (char unsigned const *) long_source + skew, len);
+
+        uint32_t line = 1, column = 1;
+        for (size_t i = 0; i <= len; ++i)
+        {
+            have = lex_position(&lexer, i);
+            assert(line == have.line && column == have.column);
+
+            if (i < len && '\n' == long_source[skew + i])
+                ++line, column = 1;
+            else
+                ++column;
+        }
+
+        lex_free(&lexer);
+    }
+
+    lex_setup_n(&lexer, (char unsigned const *) "", 0);
+    have = lex_position(&lexer, 0);
+    assert(1 == have.line && 1 == have.column);
+    lex_free(&lexer);
+}
+
+/* Apply to the NUL-terminated SOURCE, lexed into STREAM, the edit that
+   replaces the OLD_LEN bytes at OFFSET with TEXT, relex it, and check that
+   STREAM then holds what lexing the edited source anew gives.  SOURCE must
+   have room for the edit.  */
+static void
+check_relex(char *const source, struct tstream_t *const stream,
+                size_t const offset, size_t const old_len, char const *const text)
+{
+    size_t const len     = strlen(source);
+    size_t const new_len = strlen(text);
+
+    memmove(source + offset + new_len, source + offset + old_len, len - offset - old_len + 1);
+    memcpy(source + offset, text, new_len);
+
+    struct lexer_t   lexer;
+    struct tstream_t whole = { 0 };
+
+    lex_setup(&lexer, (char unsigned const *) source);
+    assert(0 == lex_relex(&lexer, stream, offset, old_len, new_len));
+
+    lex_setup(&lexer, (char unsigned const *) source);
+    lex_start(&lexer, &whole);
+
+    assert(whole.size == stream->size);
+
+    for (size_t i = 0; i < whole.size; ++i)
+    {
+        struct token_t const want = whole.tokens[i];
+        struct token_t const have = stream->tokens[i];
+
+        assert(want.type == have.type);
+        assert(want.pos == have.pos);
+        assert(want.flags == have.flags);
+        assert(want.val.text.len == have.val.text.len);
+        assert(want.val.text.str == have.val.text.str);
+        assert(want.ival == have.ival);
+    }
+
+    tstream_free(&whole);
+}
+
+static void
+test_lex_relex(void)
+{
+    static char const *const pieces[] = {
+        " ", "\n", "x", "größe", "42", "1.5e3", "0x1F", ":=", "+", "<", "=", "∈",
+        "{", "}", "{{*", "*}}", "\"", "$PI", "\\exec -f", "func", "..", ".", "*",
+    };
+
+    char             source[4096];
+    struct tstream_t stream = { 0 };
+    struct lexer_t   lexer;
+    uint32_t         seed = 7;
+
+    /* Plain edits.  */
+    strcpy(source, "a := 1 + b;\nc := {{* note *}} 2;");
+    lex_setup(&lexer, (char unsigned const *) source);
+    lex_start(&lexer, &stream);
+
+    check_relex(source, &stream, 5, 1, "100");     /* a := 100 + b;  */
+    check_relex(source, &stream, 0, 1, "alpha");   /* The first token.  */
+    check_relex(source, &stream, strlen(source), 0, " + d");
+    check_relex(source, &stream, 14, 0, "\"");     /* Open a string...  */
+    check_relex(source, &stream, 14, 1, "");       /* ...and take it back.  */
+    check_relex(source, &stream, 6, 0, "{{*");     /* Open a comment...  */
+    check_relex(source, &stream, 20, 0, "*}}");    /* ...and close it early.  */
+    check_relex(source, &stream, 0, strlen(source), "");
+
+    tstream_free(&stream);
+
+    /* Random edits of random sources.  */
+    for (int round = 0; round < 200; ++round)
+    {
+        size_t len = 0;
+
+        source[0] = '\0';
+        for (int i = 0; i < 60; ++i)
+        {
+            seed = seed * 1103515245 + 12345;
+
+            char const *const piece = pieces[(seed >> 16) % (sizeof(pieces) / sizeof(pieces[0]))];
+            strcpy(source + len, piece);
+            len += strlen(piece);
+        }
+
+        lex_setup(&lexer, (char unsigned const *) source);
+        lex_start(&lexer, &stream);
+
+        for (int edit = 0; edit < 10; ++edit)
+        {
+            char text[64] = "";
+
+            seed = seed * 1103515245 + 12345;
+            for (uint32_t i = 0; i < (seed >> 28) % 4; ++i)
+                strcat(text, pieces[(seed >> (4 * i)) % (sizeof(pieces) / sizeof(pieces[0]))]);
+
+            len = strlen(source);
+
+            seed = seed * 1103515245 + 12345;
+            size_t offset = (seed >> 8) % (len + 1);
+
+            /* Never split a multibyte character.  */
+            while (offset < len && 0x80 == ((char unsigned) source[offset] & 0xC0))
+                ++offset;
+
+            size_t old_len = (seed >> 24) % 8;
+            if (old_len > len - offset)
+                old_len = len - offset;
+
+            while (offset + old_len < len && 0x80 == ((char unsigned) source[offset + old_len] & 0xC0))
+                ++old_len;
+
+            check_relex(source, &stream, offset, old_len, text);
+        }
+
+        tstream_free(&stream);
+    }
+}
+
+static void
+test_lex_cache(void)
+{
+    static char input[4096];
+    for (size_t len = 0; len + 16 < sizeof(input); len += 16)
+        memcpy(input + len, len % 48 ? "x := \"s\" + 1.5; " : "{{* c *}} [$PI]`", 16);
+
+    char unsigned const *const source = (char unsigned const *) input;
+    size_t const               len    = strlen(input);
+    char const *const          path   = "tests.lxc";
+
+    /* Every byte counts, wherever it is.  */
+    uint64_t const hash = lex_cache_hash(source, len);
+
+    for (size_t n = 0; n < 100; ++n)
+    {
+        char copy[100];
+        memcpy(copy, input, n);
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            copy[i] ^= 1;
+            assert(lex_cache_hash((char unsigned const *) copy, n) != lex_cache_hash(source, n));
+            copy[i] ^= 1;
+        }
+
+        assert(lex_cache_hash((char unsigned const *) copy, n) == lex_cache_hash(source, n));
+    }
+
+    struct lexer_t    lexer;
+    struct ctstream_t stream = { 0 };
+
+    lex_setup(&lexer, source);
+    assert(0 == lex_start_compact(&lexer, &stream));
+    lex_free(&lexer);
+
+    assert(0 == lex_cache_store(path, &stream, hash, len));
+
+    struct lex_cache_t cache;
+    assert(0 == lex_cache_load(path, hash, len, &cache));
+    assert(cache.stream.size == stream.size);
+
+    for (size_t i = 0; i < stream.size; ++i)
+    {
+        struct token_t const want = ctstream_get(&stream, source, i);
+        struct token_t const have = ctstream_get(&cache.stream, source, i);
+
+        assert(want.type == have.type);
+        assert(want.pos == have.pos);
+        assert(want.flags == have.flags);
+        assert(want.val.text.str == have.val.text.str);
+        assert(want.val.text.len == have.val.text.len);
+        assert(want.ival == have.ival);
+    }
+
+    lex_cache_free(&cache);
+
+    /* Another source, or a file cut short, is no hit.  */
+    assert(-1 == lex_cache_load(path, hash + 1, len, &cache));
+    assert(-1 == lex_cache_load(path, hash, len - 1, &cache));
+
+    FILE *const fp = fopen(path, "rb");
+    assert(fp);
+    static char unsigned file[65536];
+    size_t const file_len = fread(file, 1, sizeof(file), fp);
+    fclose(fp);
+
+    FILE *const cut = fopen(path, "wb");
+    assert(cut);
+    assert(file_len - 1 == fwrite(file, 1, file_len - 1, cut));
+    fclose(cut);
+
+    assert(-1 == lex_cache_load(path, hash, len, &cache));
+
+    unlink(path);
+    assert(-1 == lex_cache_load(path, hash, len, &cache));
+
+    ctstream_free(&stream);
+}
+
+static void
+test_lex_trace(void)
+{
+    char const *const input = "x := 12 + yy; {{* c *}} \"s\"";
+
+    struct lexer_t     lexer;
+    struct tstream_t   stream = { 0 };
+    struct lex_trace_t total;
+
+    lex_trace_reset();
+    lex_setup(&lexer, (char unsigned const *) input);
+    lex_start(&lexer, &stream);
+    lex_trace_collect(&total);
+
+    /* Nothing is counted unless tracing is compiled in.  */
+    uint64_t const on = LEX_TRACE ? 1 : 0;
+
+    assert(on * 2 == total.points[LEX_TRACE_NAME].tokens);
+    assert(on * 3 == total.points[LEX_TRACE_NAME].bytes);
+    assert(on * 1 == total.points[LEX_TRACE_NUMBER].tokens);
+    assert(on * 3 == total.points[LEX_TRACE_OPERATOR].tokens);
+    assert(on * 9 == total.points[LEX_TRACE_COMMENT].bytes);
+    assert(on * 3 == total.points[LEX_TRACE_STRING].bytes);
+
+    /* Counts of threads that are done are kept.  Pieces that start in the
+       middle of a token are scanned again, and counted again.  */
+    static char big[1 << 18];
+    for (size_t len = 0; len + 8 < sizeof(big); len += 8)
+        memcpy(big + len, "abc + 1 ", 8);
+
+    lex_trace_reset();
+    tstream_reset(&stream);
+    lex_setup(&lexer, (char unsigned const *) big);
+    assert(0 == lex_start_parallel(&lexer, &stream, 4));
+    lex_trace_collect(&total);
+
+    assert(on * (stream.size - 1) <= total.points[LEX_TRACE_NAME].tokens
+                                        + total.points[LEX_TRACE_NUMBER].tokens
+                                        + total.points[LEX_TRACE_OPERATOR].tokens);
+
+    tstream_free(&stream);
+}
+
+/* Check that DIAGS holds exactly the N problems in WANT.  */
+static void
+check_diag_table(struct lex_diags_t const *const diags,
+                    struct lex_diag_t const *const want, size_t const n)
+{
+    assert(n == diags->size);
+    assert(!diags->failed);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        assert(want[i].pos == diags->items[i].pos);
+        assert(want[i].kind == diags->items[i].kind);
+    }
+}
+
+/* Lex the LEN bytes at INPUT, first as a whole, then in chunks of every size
+   and through `lex_next', and check that every way finds the N problems in
+   WANT, each both as a TOK_UNK token and in the side table, along with the
+   same tokens.  */
+static void
+check_diags(char const *const input, size_t const len,
+                struct lex_diag_t const *const want, size_t const n)
+{
+    struct lexer_t     lexer;
+    struct tstream_t   whole = { 0 };
+    struct lex_diags_t diags = { 0 };
+
+    lex_setup_n(&lexer, (char unsigned const *) input, len);
+    lexer.diags = &diags;
+    assert(0 == lex_start(&lexer, &whole));
+
+    check_diag_table(&diags, want, n);
+
+    size_t k = 0;
+    for (size_t i = 0; i < whole.size; ++i)
+    {
+        if (TOK_UNK != whole.tokens[i].type)
+            continue;
+
+        assert(k < n);
+        assert(want[k].pos == whole.tokens[i].pos);
+        assert(want[k].kind == whole.tokens[i].flags);
+        ++k;
+    }
+
+    assert(n == k);
+
+    for (size_t chunk = 1; chunk <= len; ++chunk)
+    {
+        struct tstream_t stream = { 0 };
+
+        lex_diags_free(&diags);
+        lex_setup_stream(&lexer);
+        lexer.diags = &diags;
+
+        for (size_t off = 0; off < len; off += chunk)
+            assert(0 == lex_feed(&lexer, (char unsigned const *) input + off,
+                                 len - off < chunk ? len - off : chunk, &stream));
+
+        assert(0 == lex_finish(&lexer, &stream));
+        assert(whole.size == stream.size);
+
+        for (size_t i = 0; i < whole.size; ++i)
+        {
+            assert(whole.tokens[i].type == stream.tokens[i].type);
+            assert(whole.tokens[i].flags == stream.tokens[i].flags);
+            assert(whole.tokens[i].pos == stream.tokens[i].pos);
+        }
+
+        check_diag_table(&diags, want, n);
+
+        lex_free(&lexer);
+        tstream_free(&stream);
+    }
+
+    struct token_t tok;
+    size_t         i = 0;
+
+    lex_diags_free(&diags);
+    lex_setup_n(&lexer, (char unsigned const *) input, len);
+    lexer.diags = &diags;
+
+    while (lex_next(&lexer, &tok))
+    {
+        assert(whole.tokens[i].type == tok.type);
+        assert(whole.tokens[i].pos == tok.pos);
+        ++i;
+    }
+
+    assert(whole.size == i + 1);
+    check_diag_table(&diags, want, n);
+
+    lex_free(&lexer);
+    lex_diags_free(&diags);
+    tstream_free(&whole);
+}
+
+static void
+test_lex_diag(void)
+{
+#define DIAGS(in, ...) \
+    check_diags(in, sizeof(in) - 1, (struct lex_diag_t[]) { __VA_ARGS__ }, \
+                sizeof( (struct lex_diag_t[]) { __VA_ARGS__ } ) / sizeof(struct lex_diag_t))
+
+    /* Scanning goes on right past each problem.  */
+    DIAGS("a ` b", { 2, DIAG_STRAY });
+    DIAGS("a\0b", { 1, DIAG_STRAY });
+    DIAGS("a \xFF\xBF\xBF b", { 2, DIAG_UTF8 });
+    DIAGS("a \xE2\x8C b", { 2, DIAG_UTF8 });
+    DIAGS("a \xE2\x8C", { 2, DIAG_UTF8 });
+    DIAGS("a $ b $", { 2, DIAG_CONST }, { 6, DIAG_CONST });
+    DIAGS("\\ a", { 0, DIAG_CMD });
+    DIAGS("a \"b c", { 2, DIAG_STRING });
+    DIAGS("a {{* b", { 2, DIAG_COMMENT });
+    DIAGS("` \x80 $ \"x {{* y", { 0, DIAG_STRAY }, { 2, DIAG_UTF8 }, { 4, DIAG_CONST },
+                                  { 6, DIAG_STRING }, { 9, DIAG_COMMENT });
+
+#undef DIAGS
+
+    /* Whatever strings and comments hold is no problem, even when they
+       are cut across chunks.  */
+    char const *const clean = "a \"b ` \xFF\" {{* $ \\ *}} c";
+    check_diags(clean, strlen(clean), nullptr, 0);
+
+    /* The tokens past a problem are those that would be there without it,
+       however the source is split across threads.  */
+    static char big[1 << 18];
+    for (size_t len = 0; len + 16 < sizeof(big); len += 16)
+        memcpy(big + len, len % 4096 ? "x := \"s\" + 1.5; " : "x ` \xFF {{* c *}} ", 16);
+
+    struct lexer_t     lexer;
+    struct tstream_t   want  = { 0 }, have = { 0 };
+    struct lex_diags_t seq   = { 0 }, par  = { 0 };
+
+    lex_setup(&lexer, (char unsigned const *) big);
+    lexer.diags = &seq;
+    assert(0 == lex_start(&lexer, &want));
+    assert(2 * (sizeof(big) / 4096) == seq.size);
+
+    lex_setup(&lexer, (char unsigned const *) big);
+    lexer.diags = &par;
+    assert(0 == lex_start_parallel(&lexer, &have, 4));
+
+    assert(want.size == have.size);
+    check_diag_table(&par, seq.items, seq.size);
+
+    for (size_t i = 0; i < want.size; ++i)
+    {
+        assert(want.tokens[i].type == have.tokens[i].type);
+        assert(want.tokens[i].flags == have.tokens[i].flags);
+        assert(want.tokens[i].pos == have.tokens[i].pos);
+    }
+
+    tstream_free(&want);
+    tstream_free(&have);
+    lex_diags_free(&seq);
+    lex_diags_free(&par);
+
+    for (enum lex_diag_kind kind = DIAG_NONE; kind < MAX_DIAGS; ++kind)
+        assert(lex_diag_message(kind));
+
+    assert(0 == strcmp(lex_diag_message(DIAG_STRING), "unterminated string"));
+    assert(lex_diag_message(MAX_DIAGS) == lex_diag_message(DIAG_NONE));
+}
+
+int
+main(void)
+{
+    /* Every scanning kernel must produce exactly the same tokens.  */
+    for (enum simd_level level = SIMD_SCALAR; level <= SIMD_AVX2; ++level)
+    {
+        if (simd_use(level) == level)
+        {
+            test_lex();
+            test_lex_bounded();
+            test_lex_stream();
+            test_lex_next();
+            test_lex_compact();
+            test_lex_too_large();
+            test_lex_symtab();
+            test_lex_alloc();
+            test_lex_parallel();
+            test_lex_validate();
+            test_lex_number();
+            test_lex_real();
+            test_lex_keyword();
+            test_lex_const();
+            test_lex_operator();
+            test_lex_position();
+            test_lex_relex();
+            test_lex_cache();
+            test_lex_trace();
+            test_lex_diag();
+        }
+    }
+
     return 0;
 }
 
@@ -0,0 +1,200 @@
+/*
+ * lexer_trace.c -- Counters of where lexing time goes.
+ *
+ * https://github.com/fontseca/lexemn
+ *
+ * Copyright (C) 2026 by Jeremy Fonseca <fontseca.dev@outlook.com>
+ *
+ * This file is part of Lexemn.
+ *
+ * Lexemn is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Lexemn is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Lexemn. If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <threads.h>
+#include <time.h>
+
+#include "lexer_trace.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <x86intrin.h>
+#endif
+
+/* Counters of one thread, linked to those of the others.  */
+struct trace_buffer
+{
+    struct lex_trace_t   counts;
+    struct trace_buffer *next;
+};
+
+thread_local struct lex_trace_t *lex_trace_local;
+
+/* Counters of every thread that is still running, and the sum of those of
+   the threads that are done, guarded by LOCK.  */
+static struct trace_buffer *buffers;
+static struct lex_trace_t   retired;
+static mtx_t                lock;
+
+/* Buffer of the calling thread, so it can be retired when the thread is
+   done.  */
+static tss_t     owner;
+static once_flag init_once = ONCE_FLAG_INIT;
+static bool      ready;
+
+/* Add the counters of BUFFER, a thread that is done, to the retired ones
+   and release it.  */
+static void
+trace_retire(void *const data)
+{
+    struct trace_buffer *const buffer = data;
+
+    mtx_lock(&lock);
+
+    for (struct trace_buffer **p = &buffers; *p; p = &(*p)->next)
+    {
+        if (*p == buffer)
+        {
+            *p = buffer->next;
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < LEX_TRACE_POINTS; ++i)
+    {
+        retired.points[i].calls  += buffer->counts.points[i].calls;
+        retired.points[i].bytes  += buffer->counts.points[i].bytes;
+        retired.points[i].tokens += buffer->counts.points[i].tokens;
+        retired.points[i].ticks  += buffer->counts.points[i].ticks;
+    }
+
+    mtx_unlock(&lock);
+    free(buffer);
+}
+
+static void
+trace_init(void)
+{
+    ready = thrd_success == mtx_init(&lock, mtx_plain)
+                && thrd_success == tss_create(&owner, trace_retire);
+}
+
+struct lex_trace_t *
+lex_trace_attach(void)
+{
+    call_once(&init_once, trace_init);
+    if (!ready)
+        return nullptr;
+
+    struct trace_buffer *const buffer = calloc(1, sizeof(*buffer));
+    if (!buffer)
+        return nullptr;
+
+    mtx_lock(&lock);
+    buffer->next = buffers;
+    buffers      = buffer;
+    mtx_unlock(&lock);
+
+    (void) tss_set(owner, buffer);
+    lex_trace_local = &buffer->counts;
+    return lex_trace_local;
+}
+
+uint64_t
+lex_trace_clock(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+#endif
+}
+
+void
+lex_trace_collect(struct lex_trace_t *const total)
+{
+    *total = (struct lex_trace_t) { 0 };
+
+    call_once(&init_once, trace_init);
+    if (!ready)
+        return;
+
+    mtx_lock(&lock);
+    *total = retired;
+
+    for (struct trace_buffer const *buffer = buffers; buffer; buffer = buffer->next)
+    {
+        for (size_t i = 0; i < LEX_TRACE_POINTS; ++i)
+        {
+            total->points[i].calls  += buffer->counts.points[i].calls;
+            total->points[i].bytes  += buffer->counts.points[i].bytes;
+            total->points[i].tokens += buffer->counts.points[i].tokens;
+            total->points[i].ticks  += buffer->counts.points[i].ticks;
+        }
+    }
+
+    mtx_unlock(&lock);
+}
+
+void
+lex_trace_reset(void)
+{
+    call_once(&init_once, trace_init);
+    if (!ready)
+        return;
+
+    mtx_lock(&lock);
+    retired = (struct lex_trace_t) { 0 };
+
+    for (struct trace_buffer *buffer = buffers; buffer; buffer = buffer->next)
+        buffer->counts = (struct lex_trace_t) { 0 };
+
+    mtx_unlock(&lock);
+}
+
+void
+lex_trace_dump(FILE *const fp)
+{
+    static char const *const labels[LEX_TRACE_POINTS] = {
+#define TRACE( name, label ) label,
+        LEX_TRACE_TABLE
+#undef TRACE
+    };
+
+    if (!LEX_TRACE)
+    {
+        fprintf(fp, "Tracing is off; build with -DLEX_TRACE=ON\n");
+        return;
+    }
+
+    struct lex_trace_t total;
+    lex_trace_collect(&total);
+
+    fprintf(fp, "%-14s %12s %14s %12s %16s %11s\n",
+            "", "calls", "bytes", "tokens", "ticks", "ticks/byte");
+
+    for (size_t i = 0; i < LEX_TRACE_POINTS; ++i)
+    {
+        struct lex_trace_counter const *const c = &total.points[i];
+
+        fprintf(fp, "%-14s %12" PRIu64 " %14" PRIu64 " %12" PRIu64 " %16" PRIu64,
+                labels[i], c->calls, c->bytes, c->tokens, c->ticks);
+
+        if (c->bytes > 0 && c->ticks > 0)
+            fprintf(fp, " %11.2f", (double) c->ticks / (double) c->bytes);
+
+        fputc('\n', fp);
+    }
+}
@@ -0,0 +1,149 @@
+/*
+ * lexer_trace.h -- Counters of where lexing time goes.
+ *
+ * https://github.com/fontseca/lexemn
+ *
+ * Copyright (C) 2026 by Jeremy Fonseca <fontseca.dev@outlook.com>
+ *
+ * This file is part of Lexemn.
+ *
+ * Lexemn is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Lexemn is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Lexemn. If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#ifndef TOK_LEXER_TRACE_H
+#define TOK_LEXER_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Tracing is compiled in with `-DLEX_TRACE=ON' (see CMakeLists.txt).
+   Otherwise the hooks in the lexer expand to nothing, and the functions
+   below find nothing to report.  */
+#ifndef LEX_TRACE
+#  define LEX_TRACE  0
+#endif
+
+/* Points of the lexer that are traced: the sub-lexers, which count the
+   bytes and tokens they scan, the UTF-8 decoder, which counts calls, and
+   token streams, which count the bytes they grow by.  */
+#define LEX_TRACE_TABLE \
+    TRACE(BLANK,     "white space")    \
+    TRACE(COMMENT,   "comments")       \
+    TRACE(NAME,      "names")          \
+    TRACE(NUMBER,    "numbers")        \
+    TRACE(STRING,    "strings")        \
+    TRACE(CONST,     "constants")      \
+    TRACE(CMD,       "meta-commands")  \
+    TRACE(OPERATOR,  "operators")      \
+    TRACE(OTHER,     "stray bytes")    \
+    TRACE(DECODE,    "UTF-8 decodes")  \
+    TRACE(GROW,      "stream growth")
+
+enum lex_trace_point : unsigned char
+{
+#define TRACE( name, label ) LEX_TRACE_ ## name,
+    LEX_TRACE_TABLE
+#undef TRACE
+    LEX_TRACE_POINTS
+};
+
+/* What a trace point has been through.  */
+struct lex_trace_counter
+{
+    uint64_t calls;
+    uint64_t bytes;
+    uint64_t tokens;
+
+    /* Time spent, in cycles of the time stamp counter on x86 and in
+       nanoseconds elsewhere.  */
+    uint64_t ticks;
+};
+
+/* Counters of every trace point.  Each thread that lexes has its own, so
+   counting takes no lock nor atomic operation.  */
+struct lex_trace_t
+{
+    struct lex_trace_counter points[LEX_TRACE_POINTS];
+};
+
+/* Counters of the calling thread, or nullptr until it records anything.  */
+extern thread_local struct lex_trace_t *lex_trace_local;
+
+/* Return the counters of the calling thread, set up on first use, or
+   nullptr if there is no memory for them.  */
+struct lex_trace_t *
+lex_trace_attach(void);
+
+/* Return the current time in the unit of `ticks'.  */
+uint64_t
+lex_trace_clock(void);
+
+/* Count a pass of the calling thread through POINT that took TICKS to go
+   over BYTES bytes and scan TOKENS tokens.  */
+static inline void
+lex_trace_add(enum lex_trace_point const point,
+                size_t const bytes,
+                size_t const tokens,
+                uint64_t const ticks)
+{
+    struct lex_trace_t *const trace = lex_trace_local ? lex_trace_local
+                                                      : lex_trace_attach();
+    if (!trace)
+        return;
+
+    struct lex_trace_counter *const counter = &trace->points[point];
+
+    ++counter->calls;
+    counter->bytes  += bytes;
+    counter->tokens += tokens;
+    counter->ticks  += ticks;
+}
+
+/* Store in TOTAL the sum of the counters of all threads, including those
+   that are done.  */
+void
+lex_trace_collect(struct lex_trace_t *total);
+
+/* Zero the counters of all threads.  Counts taken while other threads
+   lex may be lost.  */
+void
+lex_trace_reset(void);
+
+/* Print the sum of the counters of all threads to FP as a table.  */
+void
+lex_trace_dump(FILE *fp);
+
+/* Hooks for the lexer.  `TRACE_SCAN (point, lexer, stream, ...)' runs the
+   statements after STREAM and counts how far they moved LEXER and how many
+   tokens they appended to STREAM towards POINT.  `TRACE_COUNT (point,
+   bytes)' counts a call with no timing.  */
+#if LEX_TRACE
+#  define TRACE_SCAN( point, lexer, stream, ... ) \
+    do \
+    { \
+        char unsigned const *const trace_from_  = (lexer)->cur; \
+        size_t const               trace_size_  = (stream)->size; \
+        uint64_t const             trace_start_ = lex_trace_clock(); \
+        __VA_ARGS__; \
+        lex_trace_add(LEX_TRACE_ ## point, (size_t) ((lexer)->cur - trace_from_), \
+                      (stream)->size - trace_size_, lex_trace_clock() - trace_start_); \
+    } while (0)
+#  define TRACE_COUNT( point, bytes ) \
+    lex_trace_add(LEX_TRACE_ ## point, ( bytes ), 0, 0)
+#else
+#  define TRACE_SCAN( point, lexer, stream, ... )  do { __VA_ARGS__; } while (0)
+#  define TRACE_COUNT( point, bytes )              ( (void) 0 )
+#endif
+
+#endif //TOK_LEXER_TRACE_H
@@ -0,0 +1,121 @@
+/*
+ * symtab.c -- Table of interned identifiers.
+ *
+ * https://github.com/fontseca/lexemn
+ *
+ * Copyright (C) 2026 by Jeremy Fonseca <fontseca.dev@outlook.com>
+ *
+ * This file is part of Lexemn.
+ *
+ * Lexemn is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Lexemn is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Lexemn. If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "symtab.h"
+
+/* Double the slots of TABLE and put every symbol back.  Slots are at most
+   half full, so probe sequences stay short.  */
+[[nodiscard]]
+static int
+symtab_rehash(struct symtab_t *const table)
+{
+    size_t const    nslots = table->nslots < 64 ? 64 : 2 * table->nslots;
+    uint32_t *const slots  = calloc(nslots, sizeof(uint32_t));
+
+    if (!slots)
+        return -1;
+
+    for (size_t id = 1; id < table->size; ++id)
+    {
+        size_t i = table->syms[id].hash & (nslots - 1);
+
+        while (SYM_NONE != slots[i])
+            i = (i + 1) & (nslots - 1);
+
+        slots[i] = (uint32_t) id;
+    }
+
+    free(table->slots);
+    table->slots  = slots;
+    table->nslots = nslots;
+    return 0;
+}
+
+uint32_t
+symtab_intern(struct symtab_t *const table,
+                char unsigned const *const name,
+                size_t const len,
+                uint32_t const hash)
+{
+    if (2 * table->size >= table->nslots && 0 != symtab_rehash(table))
+        return SYM_NONE;
+
+    size_t i = hash & (table->nslots - 1);
+
+    for (uint32_t id; SYM_NONE != (id = table->slots[i]); i = (i + 1) & (table->nslots - 1))
+    {
+        struct identifier const *const sym = &table->syms[id];
+
+        if (sym->hash == hash && sym->len == len && 0 == memcmp(sym->name, name, len))
+            return id;
+    }
+
+    if (table->size >= UINT32_MAX)
+        return SYM_NONE;
+
+    if (table->size + 1 > table->capacity)
+    {
+        size_t const       cap  = table->capacity < 64 ? 64 : 2 * table->capacity;
+        struct identifier *syms = realloc(table->syms, cap * sizeof(struct identifier));
+
+        if (!syms)
+            return SYM_NONE;
+
+        table->syms     = syms;
+        table->capacity = cap;
+
+        /* Make room for `SYM_NONE'.  */
+        if (0 == table->size)
+            table->syms[table->size++] = (struct identifier) { .name = (char unsigned const *) "" };
+    }
+
+    char unsigned *const copy = arena_alloc(&table->names, len + 1, 1);
+    if (!copy)
+        return SYM_NONE;
+
+    memcpy(copy, name, len);
+    copy[len] = '\0';
+
+    uint32_t const id = (uint32_t) table->size++;
+    table->syms[id]   = (struct identifier) { .name = copy, .len = len, .hash = hash };
+    table->slots[i]   = id;
+    return id;
+}
+
+struct identifier const *
+symtab_get(struct symtab_t const *const table,
+                uint32_t const id)
+{
+    return &table->syms[id];
+}
+
+void
+symtab_free(struct symtab_t *const table)
+{
+    free(table->syms);
+    free(table->slots);
+    arena_free(&table->names);
+    *table = (struct symtab_t) { 0 };
+}
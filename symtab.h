@@ -0,0 +1,99 @@
+/*
+ * symtab.h -- Table of interned identifiers.
+ *
+ * https://github.com/fontseca/lexemn
+ *
+ * Copyright (C) 2026 by Jeremy Fonseca <fontseca.dev@outlook.com>
+ *
+ * This file is part of Lexemn.
+ *
+ * Lexemn is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Lexemn is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Lexemn. If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#ifndef TOK_SYMTAB_H
+#define TOK_SYMTAB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+/* Identifiers are hashed with 32-bit FNV-1a, one byte at a time, so the
+   lexer can compute the hash while it scans a name.  */
+#define SYM_HASH_INIT  UINT32_C(2166136261)
+#define SYM_HASH_STEP( h, b ) \
+    ( ( ( h ) ^ (uint8_t) ( b ) ) * UINT32_C(16777619) )
+
+/* Id of no symbol at all.  Interned symbols are numbered densely from one
+   in order of appearance.  */
+#define SYM_NONE  0
+
+/* A name in the symbol table.  */
+struct identifier
+{
+    char unsigned const *name;  /* NUL-terminated, stored in the table.  */
+    size_t               len;
+    uint32_t             hash;
+};
+
+/* Table of interned identifiers, so that each distinct name is stored once
+   and names can be compared by id.  A zero-initialized table is empty and
+   ready to use.  */
+struct symtab_t
+{
+    /* Symbols indexed by id; the first entry stands for `SYM_NONE'.  */
+    struct identifier *syms;
+    size_t             size;
+    size_t             capacity;
+
+    /* Open addressing hash table of symbol ids with linear probing, where
+       `SYM_NONE' marks an empty slot.  Its size is a power of two.  */
+    uint32_t *slots;
+    size_t    nslots;
+
+    /* Storage of the names.  */
+    struct arena_t names;
+};
+
+/* Return the hash of the LEN bytes at NAME.  */
+static inline uint32_t
+sym_hash(char unsigned const *const name, size_t const len)
+{
+    uint32_t h = SYM_HASH_INIT;
+
+    for (size_t i = 0; i < len; ++i)
+        h = SYM_HASH_STEP(h, name[i]);
+
+    return h;
+}
+
+/* Return the id of the LEN bytes at NAME in TABLE, whose hash is HASH (see
+   `sym_hash'), adding them to TABLE if they are not there yet.  Return
+   `SYM_NONE' if no memory is left.  */
+[[nodiscard]]
+uint32_t
+symtab_intern(struct symtab_t *table,
+                char unsigned const *name,
+                size_t len,
+                uint32_t hash);
+
+/* Return the symbol with id ID in TABLE.  */
+struct identifier const *
+symtab_get(struct symtab_t const *table,
+                uint32_t id);
+
+/* Release all the memory of TABLE, which is then empty again.  */
+void
+symtab_free(struct symtab_t *table);
+
+#endif //TOK_SYMTAB_H
@@ -0,0 +1,165 @@
+/*
+ * utf8.h -- Locale independent UTF-8 decoding.
+ *
+ * https://github.com/fontseca/lexemn
+ *
+ * Copyright (C) 2026 by Jeremy Fonseca <fontseca.dev@outlook.com>
+ *
+ * This file is part of Lexemn.
+ *
+ * Lexemn is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Lexemn is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Lexemn. If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#ifndef TOK_UTF8_H
+#define TOK_UTF8_H
+
+#include <stddef.h>
+#include <uchar.h>
+
+/* Values returned by `utf8_decode' when no character could be decoded.
+   They mirror the ones used by `mbrtoc32'.  */
+#define UTF8_INVALID    ( (size_t) -1 )
+#define UTF8_TRUNCATED  ( (size_t) -2 )
+
+/* Return non-zero value if byte B is a UTF-8 continuation byte.  */
+#define UTF8_IS_CONT( b ) \
+    ( ( ( b ) & 0xC0 ) == 0x80 )
+
+/* Return the length of the sequence introduced by the lead byte B, or zero
+   if B cannot start a multibyte sequence (continuation bytes, overlong
+   leads and leads past U+10FFFF).  */
+#define UTF8_SEQ_LEN( b ) \
+    ( ( b ) < 0xC2 ? 0 : ( b ) < 0xE0 ? 2 : ( b ) < 0xF0 ? 3 : ( b ) < 0xF5 ? 4 : 0 )
+
+/* Decode the multibyte sequence starting at S, which must be before END,
+   into C32.  Overlong forms, surrogates and code points beyond U+10FFFF are
+   rejected.  A sequence that is well-formed so far but cut short by END is
+   reported as truncated.  */
+static inline size_t
+utf8_decode_multi(char32_t *const c32,
+                        char unsigned const *const s,
+                        char unsigned const *const end)
+{
+    char unsigned const b0  = s[0];
+    size_t const        len = UTF8_SEQ_LEN(b0);
+
+    if (0 == len)
+        return UTF8_INVALID;
+
+    if ((size_t) (end - s) < len)
+    {
+        for (char unsigned const *p = s + 1; p < end; ++p)
+        {
+            if (!UTF8_IS_CONT(*p))
+                return UTF8_INVALID;
+        }
+
+        return UTF8_TRUNCATED;
+    }
+
+    if (2 == len)
+    {
+        if (!UTF8_IS_CONT(s[1]))
+            return UTF8_INVALID;
+
+        *c32 = (char32_t) (b0 & 0x1F) << 6
+                    | (char32_t) (s[1] & 0x3F);
+        return 2;
+    }
+
+    if (3 == len)
+    {
+        if (!UTF8_IS_CONT(s[1]) || !UTF8_IS_CONT(s[2]))
+            return UTF8_INVALID;
+
+        char32_t const c = (char32_t) (b0 & 0x0F) << 12
+                                | (char32_t) (s[1] & 0x3F) << 6
+                                | (char32_t) (s[2] & 0x3F);
+
+        if (c < 0x800 || (c >= 0xD800 && c <= 0xDFFF))
+            return UTF8_INVALID;
+
+        *c32 = c;
+        return 3;
+    }
+
+    if (!UTF8_IS_CONT(s[1]) || !UTF8_IS_CONT(s[2]) || !UTF8_IS_CONT(s[3]))
+        return UTF8_INVALID;
+
+    char32_t const c = (char32_t) (b0 & 0x07) << 18
+                            | (char32_t) (s[1] & 0x3F) << 12
+                            | (char32_t) (s[2] & 0x3F) << 6
+                            | (char32_t) (s[3] & 0x3F);
+
+    if (c < 0x10000 || c > 0x10FFFF)
+        return UTF8_INVALID;
+
+    *c32 = c;
+    return 4;
+}
+
+/* Decode the character at S, which must be before END, into C32 and return
+   its length in bytes, or one of `UTF8_INVALID' and `UTF8_TRUNCATED' if S
+   does not start a well-formed sequence.  ASCII bytes are handled inline
+   without any call.  */
+static inline size_t
+utf8_decode(char32_t *const c32,
+                char unsigned const *const s,
+                char unsigned const *const end)
+{
+    if (s[0] < 0x80)
+    {
+        *c32 = s[0];
+        return 1;
+    }
+
+    return utf8_decode_multi(c32, s, end);
+}
+
+/* Like `utf8_decode', but S is known to start a well-formed sequence that
+   ends before the end of the input, so nothing is checked at all.  */
+static inline size_t
+utf8_decode_trusted(char32_t *const c32,
+                        char unsigned const *const s)
+{
+    char unsigned const b0 = s[0];
+
+    if (b0 < 0x80)
+    {
+        *c32 = b0;
+        return 1;
+    }
+
+    if (b0 < 0xE0)
+    {
+        *c32 = (char32_t) (b0 & 0x1F) << 6
+                    | (char32_t) (s[1] & 0x3F);
+        return 2;
+    }
+
+    if (b0 < 0xF0)
+    {
+        *c32 = (char32_t) (b0 & 0x0F) << 12
+                    | (char32_t) (s[1] & 0x3F) << 6
+                    | (char32_t) (s[2] & 0x3F);
+        return 3;
+    }
+
+    *c32 = (char32_t) (b0 & 0x07) << 18
+                | (char32_t) (s[1] & 0x3F) << 12
+                | (char32_t) (s[2] & 0x3F) << 6
+                | (char32_t) (s[3] & 0x3F);
+    return 4;
+}
+
+#endif //TOK_UTF8_H